@@ -1,6 +1,8 @@
 // (c) Copyright 2016 Josh Wright
 #include "colormaps.h"
+#include "fractal/fractal_simd.h"
 #include "util/matrix.h"
+#include <algorithm>
 #include <iterator>
 #include <map>
 #include <util/debug.h>
@@ -54,12 +56,39 @@ void grayscale_to_rgb(const matrix<double> &in_double, image_RGB &out_rgb,
     throw std::runtime_error("Image dimensions must be the same!");
   }
 
-  const double *d = in_double.cbegin();
-  RGB *px = out_rgb.begin();
-  while (d < in_double.end()) {
-    *px = fun(*d);
-    ++d;
-    ++px;
+  const double *d = in_double.data();
+  RGB *px = out_rgb.data();
+  const size_t n = in_double.size();
+#pragma omp parallel for schedule(static)
+  for (size_t c = 0; c < n; c += color_chunk) {
+    const size_t end = std::min(c + color_chunk, n);
+    for (size_t i = c; i < end; i++) {
+      px[i] = fun(d[i]);
+    }
+  }
+}
+
+void grayscale_to_rgb(const matrix<double> &in_double, const tile_layout &layout,
+                      image_RGB &out_rgb, const colormap_func &fun) {
+  if (layout.linear()) {
+    grayscale_to_rgb(in_double, out_rgb, fun);
+    return;
+  }
+  if (in_double.x() != out_rgb.x() || in_double.y() != out_rgb.y()) {
+    throw std::runtime_error("Image dimensions must be the same!");
+  }
+  const size_t w = in_double.x();
+  // each row of a tile is contiguous
+#pragma omp parallel for schedule(static)
+  for (size_t y = 0; y < in_double.y(); y++) {
+    for (size_t x0 = 0; x0 < w; x0 += layout.tile) {
+      const double *d = in_double.data() + layout.index(x0, y);
+      RGB *px = out_rgb.data() + y * w + x0;
+      const size_t len = std::min(layout.tile, w - x0);
+      for (size_t i = 0; i < len; i++) {
+        px[i] = fun(d[i]);
+      }
+    }
   }
 }
 
@@ -255,6 +284,70 @@ RGB colormap::operator()(double x, double offset) const {
   return interp_color(t, left, right);
 }
 
+colormap_lut::colormap_lut(const colormap &cmap)
+    : n_colors(cmap.color_data.size() * sub_steps), black_zero(cmap.black_zero) {
+  const std::vector<RGB> &c = cmap.color_data;
+  auto pack = [](const RGB p) { return uint32_t(p.r) | uint32_t(p.g) << 8 | uint32_t(p.b) << 16; };
+  table.resize(n_colors + 2);
+  for (size_t i = 0; i < c.size(); i++) {
+    for (size_t s = 0; s < sub_steps; s++) {
+      RGB color;
+      // same edge cases as colormap::operator()
+      if (i == 0) {
+        color = c.front();
+      } else if (i == c.size() - 1) {
+        color = c.back();
+      } else {
+        color = interp_color(double(s) / sub_steps, c[i], c[i + 1]);
+      }
+      table[i * sub_steps + s] = pack(color);
+    }
+  }
+  table[nan_index()] = pack(RGB{255, 0, 0});
+  table[zero_index()] = pack(RGB{0, 0, 0});
+}
+
+RGB colormap_lut::operator()(double x) const {
+  // selects instead of branches
+  const bool zero = black_zero && x == 0.0;
+  const bool nan = x != x;
+  x = nan ? 0.0 : std::fabs(x);
+  // fmod(x, 1), anything past 2^53 has no fraction left
+  x = x < 9007199254740992.0 ? x : 0.0;
+  x -= double(int64_t(x));
+  size_t k = size_t(x * n_colors);
+  k = k < n_colors ? k : n_colors - 1;
+  k = nan ? nan_index() : k;
+  k = zero ? zero_index() : k;
+  const uint32_t p = table[k];
+  return RGB{(unsigned char)p, (unsigned char)(p >> 8), (unsigned char)(p >> 16)};
+}
+
+void colormap_lut::map(const double *in, const size_t n, RGB *out) const {
+  static const bool avx2 = detect_simd_isa() >= ISA_AVX2;
+  if (avx2) {
+    colormap_lut_map_avx2(table.data(), n_colors, black_zero, in, n, (unsigned char *)out);
+  } else {
+    for (size_t i = 0; i < n; i++) {
+      out[i] = (*this)(in[i]);
+    }
+  }
+}
+
+void grayscale_to_rgb(const matrix<double> &in_double, image_RGB &out_rgb,
+                      const colormap_lut &lut) {
+  if (in_double.x() != out_rgb.x() || in_double.y() != out_rgb.y()) {
+    throw std::runtime_error("Image dimensions must be the same!");
+  }
+  const double *d = in_double.data();
+  RGB *px = out_rgb.data();
+  const size_t n = in_double.size();
+#pragma omp parallel for schedule(static)
+  for (size_t c = 0; c < n; c += color_chunk) {
+    lut.map(d + c, std::min(color_chunk, n - c), px + c);
+  }
+}
+
 colormap::colormap(const std::vector<RGB> &color_data)
     : color_data(color_data) {}
 
@@ -4,6 +4,7 @@
 #include "generators.h"
 #include "types.h"
 #include "util/cubic_interp.h"
+#include <cstdint>
 #include <functional>
 
 namespace image_utils {
@@ -14,8 +15,17 @@ class colormap;
 
 colormap read_colormap_from_string(const std::string &spec, const size_t steps = 2048);
 
+/* pixels colored by one thread at a time, small enough to balance and large enough to not share
+ * cache lines between threads */
+const size_t color_chunk = 1 << 14;
+
+/** colors in parallel, fun must be safe to call from several threads */
 void grayscale_to_rgb(const matrix<double> &in_double, image_RGB &out_rgb, const colormap_func &fun);
 
+/** same, for a grid stored in tiles. out_rgb is always in plain rows */
+void grayscale_to_rgb(const matrix<double> &in_double, const tile_layout &layout,
+                      image_RGB &out_rgb, const colormap_func &fun);
+
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
 
@@ -37,6 +47,39 @@ public:
     }
 };
 
+/**
+ * a colormap baked into a table for coloring whole buffers. every interval of color_data is split
+ * into sub_steps interpolated colors, packed as 0x00bbggrr, so a value is one multiply and one
+ * load instead of fmod, branches and interpolation. values wrap around and zero is black like in
+ * colormap, the interpolation is rounded to 1/sub_steps of an interval.
+ *
+ * buffers are mapped with AVX2 gathers when the cpu has them
+ */
+class colormap_lut {
+public:
+    static const size_t sub_steps = 16;
+    /* the colors, then red for NaN, then black for zero */
+    std::vector<uint32_t> table;
+    size_t n_colors;
+    bool black_zero;
+
+    explicit colormap_lut(const colormap &cmap);
+
+    RGB operator()(double x) const;
+
+    void map(const double *in, const size_t n, RGB *out) const;
+
+    size_t nan_index() const { return n_colors; }
+
+    size_t zero_index() const { return n_colors + 1; }
+};
+
+void grayscale_to_rgb(const matrix<double> &in_double, image_RGB &out_rgb, const colormap_lut &lut);
+
+/** colormap_lut::map with AVX2, out is packed rgb */
+void colormap_lut_map_avx2(const uint32_t *table, const size_t n_colors, const bool black_zero,
+                           const double *in, const size_t n, unsigned char *out);
+
 class colormap_offset_waves {
     wave w;
 
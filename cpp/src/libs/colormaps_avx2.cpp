@@ -0,0 +1,62 @@
+// (c) Copyright 2017 Josh Wright
+/*
+ * built with -mavx2, and only called after checking the cpu. so no headers with inline functions
+ * here (see fractal/fractal_simd.h)
+ */
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <immintrin.h>
+
+namespace image_utils {
+
+void colormap_lut_map_avx2(const uint32_t *table, const size_t n_colors, const bool black_zero,
+                           const double *in, const size_t n, unsigned char *out) {
+  const __m256d abs_mask = _mm256_castsi256_pd(_mm256_set1_epi64x(0x7fffffffffffffff));
+  const __m256d scale = _mm256_set1_pd(double(n_colors));
+  const __m256d last = _mm256_set1_pd(double(n_colors - 1));
+  const __m256d nan_index = _mm256_set1_pd(double(n_colors));
+  const __m256d zero_index = _mm256_set1_pd(double(n_colors + 1));
+  const __m256d zero = _mm256_setzero_pd();
+  const __m256d no_fraction = _mm256_set1_pd(9007199254740992.0);
+  const __m256d black = black_zero ? _mm256_castsi256_pd(_mm256_set1_epi64x(-1)) : zero;
+  // 4 pixels of 0x00bbggrr to 12 bytes of rgb
+  const __m128i pack =
+      _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m256d x = _mm256_loadu_pd(in + i);
+    const __m256d is_zero = _mm256_and_pd(_mm256_cmp_pd(x, zero, _CMP_EQ_OQ), black);
+    const __m256d is_nan = _mm256_cmp_pd(x, x, _CMP_UNORD_Q);
+    x = _mm256_and_pd(x, abs_mask);
+    // 0 from 2^53 up like the scalar version, otherwise inf - inf would be NaN
+    x = _mm256_and_pd(x, _mm256_cmp_pd(x, no_fraction, _CMP_LT_OQ));
+    // fmod(x, 1)
+    x = _mm256_sub_pd(x, _mm256_round_pd(x, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC));
+    __m256d k = _mm256_min_pd(_mm256_mul_pd(x, scale), last);
+    k = _mm256_blendv_pd(k, nan_index, is_nan);
+    k = _mm256_blendv_pd(k, zero_index, is_zero);
+    const __m128i colors =
+        _mm_i32gather_epi32((const int *)table, _mm256_cvttpd_epi32(k), sizeof(uint32_t));
+    const __m128i rgb = _mm_shuffle_epi8(colors, pack);
+    _mm_storel_epi64((__m128i *)(out + 3 * i), rgb);
+    const int tail = _mm_extract_epi32(rgb, 2);
+    std::memcpy(out + 3 * i + 8, &tail, 4);
+  }
+  for (; i < n; i++) {
+    // same as the vector loop, one lane at a time
+    double x = in[i];
+    const bool nan = x != x;
+    const bool is_zero = black_zero && x == 0.0;
+    x = nan ? 0.0 : (x < 0 ? -x : x);
+    x = x < 9007199254740992.0 ? x : 0.0;
+    x -= double(int64_t(x));
+    size_t k = size_t(x * n_colors);
+    k = k < n_colors ? k : n_colors - 1;
+    k = nan ? n_colors : k;
+    k = is_zero ? n_colors + 1 : k;
+    std::memcpy(out + 3 * i, table + k, 3);
+  }
+}
+};
@@ -8,6 +8,18 @@ namespace image_utils {
         return worker_ref(w);
     }
 
+    json downsampling_fractal_animation::parameters() const {
+        const json parent_parameters = parent->parameters();
+        if (parent_parameters.is_null()) {
+            return json();
+        }
+        json j;
+        j["parent"] = parent_parameters;
+        j["x"] = x;
+        j["y"] = y;
+        return j;
+    }
+
     downsampling_fractal_animation::downsampling_fractal_animation(const animation_ref &parent, size_t x, size_t y)
             : parent(parent), x(x), y(y) {}
 
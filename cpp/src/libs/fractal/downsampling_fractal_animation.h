@@ -12,6 +12,8 @@ namespace image_utils {
 
     public:
         downsampling_fractal_animation(const animation_ref &parent, size_t x, size_t y);
+
+        json parameters() const override;
     private:
         worker_ref get_worker() override;
 
@@ -1,34 +1,165 @@
 // (c) Copyright 2017 Josh Wright
 #include "fractal_animation_zoom.h"
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include "fractal_perturbation.h"
+#include "post_process.h"
 
 namespace image_utils {
 
+static std::string zoom_to_string(const double zoom) {
+  std::stringstream zoom_str;
+  zoom_str << std::setprecision(17) << zoom;
+  return zoom_str.str();
+}
+
+fractal_animation_zoom::keyframe_ref fractal_animation_zoom::render_keyframe(const long k) const {
+  fractal_info cfg = base_cfg;
+  cfg.x = size_t(std::round(base_cfg.x * keyframe_scale));
+  cfg.y = size_t(std::round(base_cfg.y * keyframe_scale));
+  fractal_ref key_fractal = get_fractal(cfg);
+  key_fractal->do_sine_transform = false;
+  const double zoom = std::exp(k * std::log(keyframe_scale));
+  key_fractal->set_zoom(cfg.r, cfg.i, zoom_to_string(zoom));
+  key_fractal->run();
+  return std::make_shared<const keyframe>(
+      keyframe{zoom, untile(key_fractal->iterations, key_fractal->layout)});
+}
+
+fractal_animation_zoom::keyframe_ref fractal_animation_zoom::get_keyframe(
+    const long k, const size_t worker) const {
+  std::promise<keyframe_ref> promise;
+  std::shared_future<keyframe_ref> future;
+  bool render = false;
+  {
+    std::lock_guard<std::mutex> lock(keyframe_mutex);
+    worker_keyframes[worker] = k;
+    // nobody needs keyframes before the oldest one a worker is still on
+    const long oldest = *std::min_element(worker_keyframes.begin(), worker_keyframes.end());
+    keyframes.erase(keyframes.begin(), keyframes.lower_bound(oldest));
+    auto it = keyframes.find(k);
+    if (it != keyframes.end()) {
+      future = it->second;
+    } else {
+      future = promise.get_future().share();
+      keyframes[k] = future;
+      render = true;
+    }
+  }
+  if (render) {
+    try {
+      promise.set_value(render_keyframe(k));
+    } catch (...) {
+      promise.set_exception(std::current_exception());
+    }
+  }
+  return future.get();
+}
+
+void fractal_animation_zoom::animation_worker::reproject(const keyframe &key, const double zoom) {
+  const size_t w = resampled.x(), h = resampled.y();
+  const size_t kw = key.iterations.x(), kh = key.iterations.y();
+  const double *in = key.iterations.data();
+  // same mapping as index_to_complex: pixel x is at x / w of the way across the view
+  const double scale = key.zoom / zoom;
+#pragma omp parallel for schedule(static)
+  for (size_t y = 0; y < h; y++) {
+    const double ky = (0.5 + (y * 1.0 / h - 0.5) * scale) * kh;
+    const size_t y0 = std::min(size_t(ky), kh - 2);
+    const double fy = ky - y0;
+    for (size_t x = 0; x < w; x++) {
+      const double kx = (0.5 + (x * 1.0 / w - 0.5) * scale) * kw;
+      const size_t x0 = std::min(size_t(kx), kw - 2);
+      const double fx = kx - x0;
+      const double *row = in + y0 * kw + x0;
+      const double a = row[0], b = row[1], c = row[kw], d = row[kw + 1];
+      double out;
+      if (a == 0 || b == 0 || c == 0 || d == 0) {
+        // don't blend points inside the set with ones outside it
+        out = fy < 0.5 ? (fx < 0.5 ? a : b) : (fx < 0.5 ? c : d);
+      } else {
+        out = (a * (1 - fx) + b * fx) * (1 - fy) + (c * (1 - fx) + d * fx) * fy;
+      }
+      // distance estimates are in pixels of the keyframe, keyframe_scale * scale of them per pixel
+      resampled(x, y) = p.base_cfg.distance ? out / (p.keyframe_scale * scale) : out;
+    }
+  }
+  // what the fractal would have done itself
+  if (p.base_cfg.distance) {
+    distance_transform(resampled, p.base_cfg.mul);
+  } else {
+    log_transform(resampled);
+    sine_transform(resampled, p.base_cfg.mul);
+  }
+}
+
 void fractal_animation_zoom::animation_worker::render(double t) {
   double zoom = std::exp(t * std::log(p.max_zoom));
 
-  std::fill(fractal->iterations.begin(), fractal->iterations.end(), -1.0);
-  std::fill(color_image.begin(), color_image.end(), RGB{0, 0, 0});
+  if (p.keyframe_scale > 1) {
+    const long k = long(std::floor(std::log(zoom) / std::log(p.keyframe_scale)));
+    if (resampled.x() != p.base_cfg.x || resampled.y() != p.base_cfg.y) {
+      resampled = matrix<double>(p.base_cfg.x, p.base_cfg.y);
+    }
+    reproject(*p.get_keyframe(k, slot), zoom);
+    post_process_stats stats = post_process(resampled, tile_layout(resampled.x(), resampled.y()),
+                                            post_process_settings(), lut, color_image);
+    image_sanity_check(stats.min, stats.max, false);
+    return;
+  }
 
-  fractal->set_zoom(std::to_string(p.center[0]), std::to_string(p.center[1]), std::to_string(zoom));
+  if (!fractal) {
+    fractal = get_fractal(p.base_cfg);
+  }
+  const std::string zoom_str = zoom_to_string(zoom);
+  fractal->set_zoom(p.base_cfg.r, p.base_cfg.i, zoom_str);
   fractal->run();
+  if (auto pert = std::dynamic_pointer_cast<fractal_perturbation>(fractal)) {
+    // stderr, so it stays out of a video streamed to stdout
+    std::clog << "zoom: " << zoom_str << "\tskipped iterations: " << pert->skipped_iterations
+              << std::endl;
+  }
 
-  log_transform(fractal->iterations);
-  sine_transform(fractal->iterations);
-
-  scale_grid(fractal->iterations);
-  image_sanity_check(fractal->iterations, false);
-  grayscale_to_rgb(fractal->iterations, color_image, p.cmap);
+  // log, sine, scale and color in two passes
+  post_process_stats stats = post_process(fractal->iterations, fractal->layout,
+                                          post_process_settings(), lut, color_image);
+  image_sanity_check(stats.min, stats.max, false);
 }
 
-fractal_animation_zoom::animation_worker::animation_worker(const fractal_animation_zoom &parent)
+fractal_animation_zoom::animation_worker::animation_worker(const fractal_animation_zoom &parent,
+                                                          const size_t slot)
     : worker(),
       p(parent),
-      fractal(get_fractal(p.base_cfg)),
-      color_image(p.base_cfg.x, p.base_cfg.y, {0, 0, 0}) {}
+      slot(slot),
+      color_image(p.base_cfg.x, p.base_cfg.y, {0, 0, 0}),
+      lut(p.cmap) {}
 
 image_RGB &fractal_animation_zoom::animation_worker::get_color_image() { return color_image; }
 
-worker_ref fractal_animation_zoom::get_worker() { return std::make_shared<animation_worker>(*this); }
+json fractal_animation_zoom::parameters() const {
+  json j;
+  j["cfg"] = base_cfg;
+  j["max_zoom"] = max_zoom;
+  // colormaps don't have names, only their colors
+  const std::string colors((const char *)cmap.color_data.data(), cmap.color_data.size() * sizeof(RGB));
+  j["colormap"] = fnv1a_hash(colors);
+  j["black_zero"] = cmap.black_zero;
+  j["keyframe_scale"] = keyframe_scale;
+  return j;
+}
+
+worker_ref fractal_animation_zoom::get_worker() {
+  if (keyframe_scale > 1 && (std::round(base_cfg.x * keyframe_scale) < 2 ||
+                             std::round(base_cfg.y * keyframe_scale) < 2)) {
+    // reproject blends each pixel from a 2x2 block of the keyframe
+    throw std::runtime_error("keyframes need to be at least 2x2 pixels");
+  }
+  std::lock_guard<std::mutex> lock(keyframe_mutex);
+  // hasn't asked for a keyframe yet, so it could still need any of them
+  worker_keyframes.push_back(std::numeric_limits<long>::min());
+  return std::make_shared<animation_worker>(*this, worker_keyframes.size() - 1);
+}
 
 fractal_animation_zoom::~fractal_animation_zoom() {}
 
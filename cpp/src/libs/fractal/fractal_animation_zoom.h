@@ -1,32 +1,73 @@
 // (c) Copyright 2017 Josh Wright
 #pragma once
 
+#include <future>
+#include <map>
+#include <mutex>
+#include <vector>
 #include "fractal_animator.h"
 #include "fractal_common.h"
 
 namespace image_utils {
 class fractal_animation_zoom : public animation {
  public:
+  // center is taken from base_cfg.r and base_cfg.i, as strings to keep it precise for deep zooms
   fractal_info base_cfg;
-  vec2 center = vec2{-0.743643887037151, -0.743643887037151};
   double max_zoom = 1e12;
   colormap cmap = read_colormap_from_string("hot");
+  /*
+   * if more than 1, keyframes are rendered this many times larger in each direction at zooms of
+   * keyframe_scale^k, and every frame in between is resampled from the keyframe before it instead of
+   * being rendered. a keyframe has at least one pixel for every pixel of the frames made from it, so
+   * larger values are faster but make frames softer
+   */
+  double keyframe_scale = 1;
 
   fractal_animation_zoom(const fractal_info &cfg);
 
   worker_ref get_worker() override;
 
+  json parameters() const override;
+
   ~fractal_animation_zoom() override;
 
  private:
+  /** raw iterations of a keyframe, plain rows */
+  struct keyframe {
+    double zoom;
+    matrix<double> iterations;
+  };
+  typedef std::shared_ptr<const keyframe> keyframe_ref;
+
+  /* keyframes by k, shared by all workers. each is rendered by the first worker that needs it */
+  mutable std::mutex keyframe_mutex;
+  mutable std::map<long, std::shared_future<keyframe_ref>> keyframes;
+  /*
+   * the last keyframe each worker asked for, by worker. a worker gets its frames in order, so it
+   * never needs a keyframe before that one again, but the workers can be on different frames
+   */
+  mutable std::vector<long> worker_keyframes;
+
+  keyframe_ref get_keyframe(const long k, const size_t worker) const;
+
+  keyframe_ref render_keyframe(const long k) const;
+
   struct animation_worker : worker {
     const fractal_animation_zoom &p;
+    /* index into p.worker_keyframes */
+    const size_t slot;
+    /* only made when frames are rendered directly instead of from keyframes */
     fractal_ref fractal;
     image_RGB color_image;
-    animation_worker(const fractal_animation_zoom &parent);
+    colormap_lut lut;
+    /* frame resampled from a keyframe */
+    matrix<double> resampled;
+    animation_worker(const fractal_animation_zoom &parent, const size_t slot);
 
     void render(double t) override;
 
+    void reproject(const keyframe &key, const double zoom);
+
     image_RGB &get_color_image() override;
   };
 };
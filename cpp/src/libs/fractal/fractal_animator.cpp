@@ -1,39 +1,269 @@
 // (c) Copyright 2016 Josh Wright
 #include "fractal_animator.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include "util/mpmc_queue.h"
 
 namespace image_utils {
 
-    fractal_animator::fractal_animator(animation_ref animation) : animation(animation) {
-        threads.reserve((unsigned long) omp_get_max_threads());
-        for (int i = 0; i < omp_get_max_threads(); i++) {
-            threads.push_back(animation->get_worker());
+    fractal_animator::fractal_animator(animation_ref animation) : animation(animation) {}
+
+    thread_plan fractal_animator::plan_threads(const size_t pixels, const size_t cores) const {
+        thread_plan plan;
+        if (threads_per_frame > 0) {
+            plan.threads_per_frame = threads_per_frame;
+        } else if (parallel_frames > 0) {
+            plan.threads_per_frame = std::max(cores / parallel_frames, size_t(1));
+        } else {
+            const size_t wanted =
+                (pixels + pixels_per_thread - 1) / std::max(pixels_per_thread, size_t(1));
+            plan.threads_per_frame =
+                std::min(std::max(wanted, size_t(1)), std::max(cores, size_t(1)));
+        }
+        if (parallel_frames > 0) {
+            plan.frames = parallel_frames;
+        } else {
+            plan.frames = std::max(cores / plan.threads_per_frame, size_t(1));
         }
+        return plan;
+    }
+
+    /** a rendered frame waiting to be written */
+    struct frame_job {
+        size_t buffer;
+        size_t frame;
+    };
+
+    static const size_t no_frame = size_t(-1);
+
+    static size_t next_power_of_2(size_t x) {
+        size_t p = 2;
+        while (p < x) {
+            p *= 2;
+        }
+        return p;
     }
 
     void fractal_animator::run() {
 //        TODO log metadata about each frame
-#pragma omp parallel for schedule(static,1)
-        for (size_t i = progress; i < n_frames; i++) {
-            const double t = i * 1.0 / n_frames;
-            worker_ref &worker = threads[omp_get_thread_num()];
-            worker->render(t);
+        /*
+         * render threads copy finished frames into a pool of buffers and go on with the next
+         * frame, encoder threads write them out and hand the buffers back. each buffer is
+         * allocated at most once, and the render threads only wait when every buffer is still
+         * being written
+         */
+        const bool streaming = !stream_output.empty();
+        // a stream on stdout can't share it with the progress messages
+        std::ostream &log = stream_output == "-" ? std::cerr : std::cout;
+        std::unique_ptr<video_stream> stream;
+        if (streaming) {
+            stream.reset(new video_stream(stream_output, stream_format, framerate));
+        }
+        // workers are made only once the frame size is known, each one holds a whole frame
+        if (threads.empty()) {
+            threads.push_back(animation->get_worker());
+        }
+        const image_RGB &first_image = threads.front()->get_color_image();
+        const thread_plan plan = plan_threads(first_image.size(), size_t(omp_get_max_threads()));
+        while (threads.size() < plan.frames) {
+            threads.push_back(animation->get_worker());
+        }
+        log << "rendering " << plan.frames << " frames at a time with " << plan.threads_per_frame
+            << " threads each" << std::endl;
+
+        // a stream is written in order, by one thread
+        const size_t n_encoders = streaming ? 1 : std::max(encoder_threads, size_t(1));
+        const size_t n_buffers = plan.frames + n_encoders;
+        std::vector<image_RGB> buffers(n_buffers);
+        const size_t capacity = next_power_of_2(n_buffers + n_encoders);
+        mpmc_queue<size_t> free_buffers(capacity);
+        mpmc_queue<frame_job> encode_queue(capacity);
+        for (size_t i = 0; i < n_buffers; i++) {
+            free_buffers.push(i);
+        }
+
+        /*
+         * frames listed in the manifest with the same hash are kept, as long as their file is still
+         * there. the manifest is only appended to, so a run that was killed leaves at most one
+         * broken line, and the last line for a frame wins
+         */
+        const json parameters = animation->parameters();
+        std::vector<uint64_t> hashes;
+        std::vector<size_t> frames;
+        std::ofstream manifest;
+        std::mutex manifest_mutex;
+        if (!streaming && resume && !parameters.is_null()) {
+            hashes.resize(n_frames);
+            for (size_t i = 0; i < n_frames; i++) {
+                hashes[i] = frame_hash(parameters, i);
+            }
+            std::map<size_t, uint64_t> done;
+            std::ifstream in(manifest_filename());
+            size_t frame;
+            uint64_t hash;
+            while (in >> frame >> std::hex >> hash >> std::dec) {
+                done[frame] = hash;
+            }
+            for (size_t i = progress; i < n_frames; i++) {
+                auto it = done.find(i);
+                if (it == done.end() || it->second != hashes[i] ||
+                    !std::ifstream(frame_filename(i)).good()) {
+                    frames.push_back(i);
+                }
+            }
+            manifest.open(manifest_filename(), std::ios::app);
+            if (!manifest) {
+                throw std::runtime_error("could not open " + manifest_filename());
+            }
+        } else {
+            for (size_t i = progress; i < n_frames; i++) {
+                frames.push_back(i);
+            }
+        }
+        if (frames.size() < n_frames - std::min(progress, n_frames)) {
+            log << "resuming: " << n_frames - frames.size() << " frames already done" << std::endl;
+        }
+
+        std::atomic<size_t> written{n_frames - frames.size()};
+        /* first frame the stream is still waiting for */
+        std::atomic<size_t> next_frame{progress};
+        std::mutex error_mutex;
+        std::exception_ptr error;
 
-            std::stringstream output;
-            output << output_folder << out_filename_prefix << std::setfill('0') << std::setw(5) << i << ".png";
+        auto write_frame = [&](const frame_job &job) {
+            try {
+                if (stream) {
+                    stream->write(buffers[job.buffer]);
+                } else {
+                    write_image(buffers[job.buffer], frame_filename(job.frame), png);
+                    if (manifest.is_open()) {
+                        std::lock_guard<std::mutex> lock(manifest_mutex);
+                        manifest << job.frame << " " << std::hex << hashes[job.frame] << std::dec
+                                 << std::endl;
+                    }
+                }
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(error_mutex);
+                if (!error) {
+                    error = std::current_exception();
+                }
+            }
+            free_buffers.push(job.buffer);
+            const size_t n_written = ++written;
+            // several encoders print at once
+            std::lock_guard<std::mutex> lock(manifest_mutex);
+            log << "rendered: \t" << n_written << "\t/" << n_frames << std::endl;
+        };
 
-            write_image(worker->get_color_image(), output.str());
+        std::vector<std::thread> encoders;
+        for (size_t e = 0; e < n_encoders; e++) {
+            encoders.emplace_back([&]() {
+                // write_image is parallel by itself, which would oversubscribe the render threads
+                omp_set_num_threads(1);
+                // frames that finished before the ones in front of them, by frame % n_buffers
+                std::vector<frame_job> pending(n_buffers, frame_job{0, no_frame});
+                for (frame_job job = encode_queue.pop(); job.frame != no_frame;
+                     job = encode_queue.pop()) {
+                    if (!stream) {
+                        write_frame(job);
+                        continue;
+                    }
+                    pending[job.frame % n_buffers] = job;
+                    for (frame_job *p = &pending[next_frame % n_buffers]; p->frame == next_frame;
+                         p = &pending[next_frame % n_buffers]) {
+                        write_frame(*p);
+                        p->frame = no_frame;
+                        ++next_frame;
+                    }
+                }
+            });
+        }
+
+        const int max_levels = omp_get_max_active_levels();
+        if (plan.threads_per_frame > 1) {
+            omp_set_max_active_levels(std::max(max_levels, 2));
+        }
+#pragma omp parallel num_threads(int(plan.frames))
+        {
+            // for the parallel loops inside the fractals
+            omp_set_num_threads(int(plan.threads_per_frame));
+#pragma omp for schedule(static,1)
+            for (size_t k = 0; k < frames.size(); k++) {
+                const size_t i = frames[k];
+                if (streaming) {
+                    /*
+                     * only start frames the reorder buffer has room for. otherwise later frames
+                     * could take every buffer while the stream waits for this one
+                     */
+                    while (i >= next_frame + n_buffers) {
+                        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                    }
+                }
+                const double t = i * 1.0 / n_frames;
+                worker_ref &worker = threads[omp_get_thread_num()];
+                worker->render(t);
 
-            std::cout << "rendered: \t" << progress << "\t/" << n_frames << std::endl;
-            ++progress;
+                const image_RGB &image = worker->get_color_image();
+                const size_t b = free_buffers.pop();
+                if (buffers[b].x() != image.x() || buffers[b].y() != image.y()) {
+                    buffers[b] = image_RGB(image.x(), image.y());
+                }
+                std::memcpy(buffers[b].data(), image.data(), image.size() * sizeof(RGB));
+                encode_queue.push(frame_job{b, i});
+            }
+        }
+        omp_set_max_active_levels(max_levels);
+
+        for (size_t e = 0; e < n_encoders; e++) {
+            encode_queue.push(frame_job{0, no_frame});
+        }
+        for (std::thread &t : encoders) {
+            t.join();
+        }
+        if (error) {
+            std::rethrow_exception(error);
         }
 
-        std::cout << "Done! Render using:" << std::endl;
-        std::cout << "ffmpeg -framerate 60 -i "
-                  << output_folder << "out_frame_%05d.png "
-                  << output_folder << "output.mp4" << std::endl;
+        log << "Done! Render using:" << std::endl;
+        if (stream) {
+            log << stream->ffmpeg_command(stream_output, "output.mp4") << std::endl;
+        } else {
+            log << "ffmpeg -framerate " << framerate << " -i "
+                << output_folder << out_filename_prefix << "%05d.png "
+                << output_folder << "output.mp4" << std::endl;
+        }
+    }
+
+    std::string fractal_animator::frame_filename(const size_t frame) const {
+        std::stringstream output;
+        output << output_folder << out_filename_prefix << std::setfill('0') << std::setw(5) << frame
+               << ".png";
+        return output.str();
+    }
+
+    std::string fractal_animator::manifest_filename() const {
+        return output_folder + out_filename_prefix + "manifest.txt";
+    }
+
+    uint64_t fractal_animator::frame_hash(const json &parameters, const size_t frame) const {
+        json j;
+        j["animation"] = parameters;
+        j["frame"] = frame;
+        j["n_frames"] = n_frames;
+        return fnv1a_hash(j.dump());
     }
 
     worker::worker() {}
 
+    json animation::parameters() const { return json(); }
+
     animation::~animation() {}
 };
\ No newline at end of file
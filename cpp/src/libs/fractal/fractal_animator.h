@@ -30,9 +30,22 @@ struct worker {
 
 struct animation {
     virtual worker_ref get_worker() = 0;
+
+    /** everything that changes the frames, to know if frames from an earlier run can be kept. null
+     * (the default) means they never can */
+    virtual json parameters() const;
+
     virtual ~animation();
 };
 
+/** how the threads are split between frames */
+struct thread_plan {
+    /* frames rendered at the same time */
+    size_t frames;
+    /* threads each of those frames uses for itself (nested openmp) */
+    size_t threads_per_frame;
+};
+
 class fractal_animator {
 protected:
     std::vector<worker_ref> threads;
@@ -42,11 +55,42 @@ public:
     std::string out_filename_prefix = "out_frame_";
     std::string output_folder = "fractal_frames";
     size_t n_frames = 200;
+    /* frames before this one are skipped */
     size_t progress = 0;
+    /* frames are usually only read once by ffmpeg */
+    png_settings png = png_settings::fast();
+    /* threads writing frames while the render threads keep rendering */
+    size_t encoder_threads = 2;
+    /* if set, frames are written in order as uncompressed video to this file, named pipe or "-"
+     * (stdout) instead of png files */
+    std::string stream_output;
+    video_format stream_format = VIDEO_Y4M;
+    size_t framerate = 60;
+    /* skip frames that the manifest lists as done with the same parameters, only for png output */
+    bool resume = true;
+    /* 0 picks them from the frame size, see plan_threads */
+    size_t parallel_frames = 0;
+    size_t threads_per_frame = 0;
+    /* automatic plans give a frame one thread for every this many pixels */
+    size_t pixels_per_thread = 1 << 18;
 
     fractal_animator(animation_ref animation);
 
     void run();
+
+    /**
+     * small frames are rendered many at a time with one thread each, so the fractals' own parallel
+     * loops don't oversubscribe the cores, and large frames get more threads each so fewer of them
+     * are in memory at once
+     */
+    thread_plan plan_threads(const size_t pixels, const size_t cores) const;
+
+    std::string frame_filename(const size_t frame) const;
+
+    /** finished frames are appended to this file as "<frame> <hash of its parameters>" */
+    std::string manifest_filename() const;
+
+    uint64_t frame_hash(const json &parameters, const size_t frame) const;
 };
 };
 #endif //IMAGE_STUFF_FRACTAL_ANIMATION_H
@@ -4,18 +4,29 @@
 
 #pragma once
 #include "fractal_common.h"
+#include "fractal_simd.h"
 #include "util/debug.h"
 
 namespace image_utils {
 
 fractal_ref get_fractal_avx_f32(const fractal_info &cfg);
 
+/** true if fractal_avx_f64 can render cfg */
+bool fractal_avx_f64_supports(const fractal_info &cfg);
+
+fractal_ref get_fractal_avx_f64(const fractal_info &cfg);
+
+/**
+ * fast single precision preview of the mandelbrot set. despite the name, runs on whichever
+ * instruction set the cpu has (see fractal_simd.h)
+ */
 class fractal_avx_f32 : public fractal {
  public:
  public:
   double pixel_width_x;
   double pixel_width_y;
   complex c = complex(0.0, 0.0);
+  simd_isa isa = detect_simd_isa();
 
  protected:
   // vec4 bounds{-2, 2, -2, 2};
@@ -31,7 +42,7 @@ class fractal_avx_f32 : public fractal {
 
   virtual void run_singlethread();
   virtual void run_multithread();
-  void run_avx_f32();
+  void run_avx_f32(bool parallel);
 
   /////////////////////////////////////////////////////////////////////////////
 
@@ -49,4 +60,48 @@ class fractal_avx_f32 : public fractal {
 
   void set_zoom(const vec2 &center, const double &zoom);
 };
+
+/**
+ * 2, 4 or 8 pixels at a time in double precision, depending on the instruction set. gives exactly
+ * the same values as fractal_impl<double, func_standard> (or func_cubic), except that every pixel
+ * is calculated instead of filling rectangles
+ */
+class fractal_avx_f64 : public fractal {
+ public:
+  double pixel_width_x;
+  double pixel_width_y;
+  complex c = complex(0.0, 0.0);
+  polynomial_t polynomial = STANDARD;
+  /* use fused multiply-add. faster, but rounds differently than fractal_impl */
+  bool fused = false;
+  simd_isa isa = detect_simd_isa();
+
+ protected:
+  vec4 bounds;
+
+ public:
+  complex index_to_complex(const vec_ull &pos);
+
+  /////////////////////////////////////////////////////////////////////////////
+
+  virtual void run_singlethread();
+  virtual void run_multithread();
+  void run_avx_f64(bool parallel);
+
+  /////////////////////////////////////////////////////////////////////////////
+
+  fractal_avx_f64(const size_t w, const size_t h);
+
+  fractal_avx_f64(const fractal_avx_f64 &rhs);
+
+  virtual void read_config(const fractal_info &cfg);
+
+  virtual void set_zoom(const std::string &r_str, const std::string &i_str,
+                        const std::string &zoom_str) {
+    set_zoom(vec2{numeric_from_string<double>(r_str), numeric_from_string<double>(i_str)},
+             numeric_from_string<double>(zoom_str));
+  }
+
+  void set_zoom(const vec2 &center, const double &zoom);
+};
 };
@@ -6,8 +6,12 @@ using namespace boost::multiprecision;
 using namespace boost::math;
 using namespace boost::math::tools;
 
+#include <stdexcept>
 #include "fractal_common.h"
+#include "fractal_avx.h"
+#include "fractal_expression.h"
 #include "fractal_impl.h"
+#include "fractal_perturbation.h"
 #include "generators.h"
 
 namespace image_utils {
@@ -43,6 +47,13 @@ void log_transform(matrix<double> &in, const double multiplier) {
   }
 }
 
+void distance_transform(matrix<double> &in, const double multiplier) {
+#pragma omp parallel for schedule(static)
+  for (size_t i = 0; i < in.size(); i++) {
+    in(i) = 1 - exp(-in(i) * multiplier);
+  }
+}
+
 // maximum precision available numeric type
 typedef mpf_float precise_numeric;
 
@@ -54,15 +65,32 @@ std::string precise_mul(const std::string &_a, const std::string &_b) {
   return ss.str();
 }
 
+polynomial_t read_polynomial(const std::string &name) {
+  if (name.empty()) {
+    return STANDARD;
+  }
+  auto it = polynomial_names.find(name);
+  if (it == polynomial_names.end()) {
+    throw std::runtime_error("unknown polynomial: " + name);
+  }
+  return it->second;
+}
+
 ///////////////////////////////////////////////////////////////////
 
 void fractal::read_config(const fractal_info &cfg) {
   iterations = matrix<double>(cfg.x, cfg.y, NOT_DEFINED);
+  layout = tile_layout(cfg.x, cfg.y);
   grid_mask = matrix<bool>(cfg.x, cfg.y, 0);
   subsample = cfg.subsample;
   smooth = cfg.smooth;
   do_grid = cfg.do_grid;
   is_julia = cfg.is_julia;
+  check_interior = cfg.interior;
+  border_trace = cfg.border_trace;
+  aa_samples = cfg.aa_samples;
+  aa_threshold = cfg.aa_threshold;
+  distance_estimate = cfg.distance;
   max_iterations = cfg.iter;
   mul = cfg.mul;
 }
@@ -71,8 +99,7 @@ template <typename numeric>
 fractal_ref get_fractal_helper(const fractal_info &cfg) {
   using std::make_shared;
   fractal_ref fract;
-  auto it = polynomial_names.find(cfg.poly);
-  switch (it->second) {
+  switch (read_polynomial(cfg.poly)) {
     case STANDARD:
       fract = make_shared<fractal_impl<numeric, func_standard<numeric>>>(cfg.x, cfg.y);
       break;
@@ -94,6 +121,15 @@ fractal_ref get_fractal_helper(const fractal_info &cfg) {
 }
 
 fractal_ref get_fractal(const fractal_info &cfg) {
+  if (is_custom_polynomial(cfg.poly)) {
+    return get_fractal_expression(cfg);
+  }
+  if (cfg.perturbation) {
+    return get_fractal_perturbation(cfg);
+  }
+  if (cfg.simd && !cfg.distance && fractal_avx_f64_supports(cfg)) {
+    return get_fractal_avx_f64(cfg);
+  }
   switch (cfg.bits) {
     case 64:
       return get_fractal_helper<double>(cfg);
@@ -106,4 +142,61 @@ fractal_ref get_fractal(const fractal_info &cfg) {
 }
 
 void fractal::run() { run_multithread(); }
+
+void fractal::apply_transform() {
+  if (distance_estimate) {
+    distance_transform(iterations, mul);
+  } else {
+    log_transform(iterations);
+    sine_transform(iterations, mul);
+  }
+}
+
+double fractal::iterate_pixel(const size_t, const size_t) {
+  throw std::runtime_error("this fractal can't render single pixels");
+}
+
+void fractal::run_progressive(const progressive_callback &callback) {
+  if (!has_pixel_access()) {
+    run();
+    callback(1);
+    return;
+  }
+  const size_t w = iterations.x(), h = iterations.y();
+  size_t iterated = 0;
+  for (size_t stride = 4; stride > 0; stride /= 2) {
+    const size_t coarse = stride * 2;
+    // only the pixels that the last level skipped
+#pragma omp parallel for schedule(dynamic, 1) reduction(+ : iterated)
+    for (size_t y = 0; y < h; y += stride) {
+      for (size_t x = 0; x < w; x += stride) {
+        if (stride == 4 || x % coarse != 0 || y % coarse != 0) {
+          cell(x, y) = iterate_pixel(x, y);
+          iterated++;
+        }
+      }
+    }
+    if (stride > 1) {
+      // the rest of each block copies the sample in its corner
+#pragma omp parallel for schedule(static)
+      for (size_t y = 0; y < h; y++) {
+        for (size_t x = 0; x < w; x++) {
+          if (x % stride != 0 || y % stride != 0) {
+            cell(x, y) = cell(x - x % stride, y - y % stride);
+          }
+        }
+      }
+    } else {
+      iterated_pixels = iterated;
+      filled_pixels = 0;
+      finish_pixels();
+      if (do_sine_transform) {
+        apply_transform();
+      }
+    }
+    if (!callback(stride)) {
+      return;
+    }
+  }
+}
 };
@@ -11,14 +11,68 @@
 namespace image_utils {
 const double NOT_DEFINED = -1.0;
 
-#define FRACTAL_POLYNOMIAL(name, expr)                                 \
-  template <typename numeric>                                          \
-  struct name {                                                        \
-    typedef std::complex<numeric> complex;                             \
-    std::complex<numeric> operator()(const std::complex<numeric> &z,   \
-                                     const std::complex<numeric> &c) { \
-      return expr;                                                     \
-    }                                                                  \
+/**
+ * a complex number and its derivative (with respect to whatever the d parts of the inputs are the
+ * derivatives of). arithmetic on these applies the chain rule, so any of the polynomials below
+ * gives its derivative along with its value
+ */
+template <typename numeric>
+struct dual_complex {
+  typedef std::complex<numeric> complex;
+  complex v, d;
+
+  dual_complex(const complex &v = complex(), const complex &d = complex()) : v(v), d(d) {}
+  dual_complex(const numeric &v) : v(v), d() {}
+};
+
+template <typename numeric>
+dual_complex<numeric> operator+(const dual_complex<numeric> &a, const dual_complex<numeric> &b) {
+  return dual_complex<numeric>(a.v + b.v, a.d + b.d);
+}
+
+template <typename numeric>
+dual_complex<numeric> operator-(const dual_complex<numeric> &a, const dual_complex<numeric> &b) {
+  return dual_complex<numeric>(a.v - b.v, a.d - b.d);
+}
+
+template <typename numeric>
+dual_complex<numeric> operator*(const dual_complex<numeric> &a, const dual_complex<numeric> &b) {
+  return dual_complex<numeric>(a.v * b.v, a.d * b.v + a.v * b.d);
+}
+
+template <typename numeric>
+dual_complex<numeric> operator/(const dual_complex<numeric> &a, const dual_complex<numeric> &b) {
+  return dual_complex<numeric>(a.v / b.v, (a.d * b.v - a.v * b.d) / (b.v * b.v));
+}
+
+/* constants in the polynomials */
+template <typename numeric>
+dual_complex<numeric> operator+(const dual_complex<numeric> &a, const numeric &b) {
+  return a + dual_complex<numeric>(b);
+}
+
+template <typename numeric>
+dual_complex<numeric> operator-(const dual_complex<numeric> &a, const numeric &b) {
+  return a - dual_complex<numeric>(b);
+}
+
+template <typename numeric>
+dual_complex<numeric> operator/(const numeric &a, const dual_complex<numeric> &b) {
+  return dual_complex<numeric>(a) / b;
+}
+
+#define FRACTAL_POLYNOMIAL(name, expr)                                   \
+  template <typename numeric>                                            \
+  struct name {                                                          \
+    typedef std::complex<numeric> complex;                               \
+    std::complex<numeric> operator()(const std::complex<numeric> &z,     \
+                                     const std::complex<numeric> &c) {   \
+      return expr;                                                       \
+    }                                                                    \
+    dual_complex<numeric> operator()(const dual_complex<numeric> &z,     \
+                                     const dual_complex<numeric> &c) {   \
+      return expr;                                                       \
+    }                                                                    \
   };
 
 FRACTAL_POLYNOMIAL(func_standard, z *z + c)
@@ -27,6 +81,50 @@ FRACTAL_POLYNOMIAL(func_quadratic_rational, (z * z) + (c * c) / ((c * c * c * c)
 FRACTAL_POLYNOMIAL(func_inv_c, (z * z) + numeric(1.0) / (c - numeric(1)))
 FRACTAL_POLYNOMIAL(func_inv_c_parabola, (z * z) + numeric(1.0) / c + numeric(0.25))
 
+/**
+ * one iteration on separate real and imaginary parts. zr2 and zi2 are the squares of the current z,
+ * which the caller keeps around for the bailout test, so the polynomials written out below don't
+ * compute them a second time. the order of operations is the same as std::complex multiplication
+ * (without its NaN recovery), so results are bit for bit the same as the generic version, which
+ * just goes through the polynomial functor
+ */
+template <typename numeric, class polynomial>
+struct polynomial_step {
+  static void step(polynomial &poly, numeric &zr, numeric &zi, const numeric &cr, const numeric &ci,
+                   const numeric &, const numeric &) {
+    const std::complex<numeric> z =
+        poly(std::complex<numeric>(zr, zi), std::complex<numeric>(cr, ci));
+    zr = z.real();
+    zi = z.imag();
+  }
+};
+
+template <typename numeric>
+struct polynomial_step<numeric, func_standard<numeric>> {
+  static void step(func_standard<numeric> &, numeric &zr, numeric &zi, const numeric &cr,
+                   const numeric &ci, const numeric &zr2, const numeric &zi2) {
+    // zr*zi + zi*zr in std::complex, both products are the same value
+    const numeric t = zr * zi;
+    zi = (t + t) + ci;
+    zr = (zr2 - zi2) + cr;
+  }
+};
+
+template <typename numeric>
+struct polynomial_step<numeric, func_cubic<numeric>> {
+  static void step(func_cubic<numeric> &, numeric &zr, numeric &zi, const numeric &cr,
+                   const numeric &ci, const numeric &zr2, const numeric &zi2) {
+    // (z*z)*z
+    const numeric t = zr * zi;
+    const numeric tr = zr2 - zi2;
+    const numeric ti = t + t;
+    const numeric sr = tr * zr - ti * zi;
+    const numeric si = tr * zi + ti * zr;
+    zr = sr + cr;
+    zi = si + ci;
+  }
+};
+
 enum polynomial_t {
   STANDARD,
   CUBIC,
@@ -42,10 +140,38 @@ const std::map<std::string, polynomial_t> polynomial_names{
     {"inv-c-parabola", INV_C_PARABOLA},
 };
 
+/**
+ * empty name means the standard polynomial, throws on unknown names. get_fractal reads anything
+ * else as an expression (see fractal_expression.h)
+ */
+polynomial_t read_polynomial(const std::string &name);
+
 void sine_transform(matrix<double> &in, const double multiplier = 1, const double rel_phase = 0,
                     bool preserve_zero = true);
 void log_transform(matrix<double> &in, const double multiplier = 1);
 
+/**
+ * for distance estimates in pixels: 1 - e^(-distance * multiplier), so the boundary of the set
+ * and the set itself stay at 0 and everything more than a few pixels away goes to 1
+ */
+void distance_transform(matrix<double> &in, const double multiplier = 1);
+
+/**
+ * true if c is inside the main cardioid or the period 2 bulb of the standard mandelbrot set, which
+ * covers most of its area
+ */
+template <typename numeric>
+bool in_cardioid_or_bulb(const numeric &x, const numeric &y) {
+  const numeric y2 = y * y;
+  const numeric xq = x - numeric(0.25);
+  const numeric q = xq * xq + y2;
+  if (q * (q + xq) <= numeric(0.25) * y2) {
+    return true;
+  }
+  const numeric x1 = x + numeric(1);
+  return x1 * x1 + y2 <= numeric(0.0625);
+}
+
 /** t on range [0,1]*/
 complex complex_circle(const complex center, const double r, const double t);
 
@@ -119,7 +245,9 @@ struct rectangle_stack : public std::vector<rectangle> {
 
 class fractal {
  public:
+  /* stored with layout, which is plain rows unless the backend supports tiles */
   matrix<double> iterations;
+  tile_layout layout;
   matrix<bool> grid_mask;
   size_t max_iterations = 512;
   bool do_grid = false;
@@ -127,9 +255,52 @@ class fractal {
   bool smooth = false;
   bool do_sine_transform = true;
   bool subsample = false;
+  /* return early for points that are known to be inside the set */
+  bool check_interior = true;
+  /* border tracing instead of splitting rectangles, where the backend supports it */
+  bool border_trace = false;
+  /* adaptive antialiasing, where the backend supports it (see fractal_info) */
+  size_t aa_samples = 0;
+  double aa_threshold = 0.1;
+  /* exterior distance estimates (in pixels) instead of iterations, where the backend supports it */
+  bool distance_estimate = false;
   double mul = 1;
 
+  /* statistics from the last run, where the backend keeps them */
+  size_t iterated_pixels = 0;
+  size_t filled_pixels = 0;
+  size_t antialiased_pixels = 0;
+
+  double &cell(const size_t x, const size_t y) { return iterations.data()[layout.index(x, y)]; }
+
   void run();
+
+  /** log_transform and sine_transform, or distance_transform for distance estimates */
+  void apply_transform();
+
+  /**
+   * called after each level of run_progressive with the stride of that level (4, 2, then 1). on the
+   * coarse levels every pixel holds the raw iterations of the nearest sample so far. the last level
+   * is finished the way run() leaves it, so it's already transformed if do_sine_transform is set.
+   * return false to stop early
+   */
+  typedef std::function<bool(const size_t stride)> progressive_callback;
+
+  /**
+   * render every 4th pixel in each direction, then every 2nd, then all of them, without computing
+   * any pixel twice. the transform is only applied after the last level. backends that can't
+   * render single pixels do a normal run and report one level
+   */
+  void run_progressive(const progressive_callback &callback);
+
+  /** for run_progressive */
+  virtual bool has_pixel_access() const { return false; }
+
+  /** raw iterations of one pixel, only if has_pixel_access */
+  virtual double iterate_pixel(const size_t x, const size_t y);
+
+  /** anything run() does to the finished raw iterations before the transform */
+  virtual void finish_pixels() {}
   virtual void run_singlethread() = 0;
   virtual void run_multithread() = 0;
 
@@ -141,9 +312,11 @@ class fractal {
   virtual void set_zoom(const std::string &r, const std::string &i,const std::string &zoom) = 0;
 
   fractal();
-  fractal(const size_t w, const size_t h) : iterations(w, h, NOT_DEFINED), grid_mask(w, h, 0) {}
+  fractal(const size_t w, const size_t h)
+      : iterations(w, h, NOT_DEFINED), layout(w, h), grid_mask(w, h, 0) {}
   fractal(const fractal &rhs)
       : iterations(rhs.iterations),
+        layout(rhs.layout),
         grid_mask(rhs.grid_mask),
         max_iterations(rhs.max_iterations),
         do_grid(rhs.do_grid),
@@ -151,6 +324,11 @@ class fractal {
         smooth(rhs.smooth),
         do_sine_transform(rhs.do_sine_transform),
         subsample(rhs.subsample),
+        check_interior(rhs.check_interior),
+        border_trace(rhs.border_trace),
+        aa_samples(rhs.aa_samples),
+        aa_threshold(rhs.aa_threshold),
+        distance_estimate(rhs.distance_estimate),
         mul(rhs.mul) {}
 };
 
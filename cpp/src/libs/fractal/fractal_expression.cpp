@@ -0,0 +1,695 @@
+// (c) Copyright 2017 Josh Wright
+#include "fractal_expression.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <stdexcept>
+#include "fractal_impl.h"
+
+namespace image_utils {
+
+/** dst = a op b for n samples */
+static void run_op(const expression_op op, const double *ar, const double *ai, const double *br,
+                   const double *bi, double *dr, double *di, const size_t n) {
+  switch (op) {
+    case EXPR_ADD:
+      for (size_t k = 0; k < n; k++) {
+        dr[k] = ar[k] + br[k];
+        di[k] = ai[k] + bi[k];
+      }
+      break;
+    case EXPR_SUB:
+      for (size_t k = 0; k < n; k++) {
+        dr[k] = ar[k] - br[k];
+        di[k] = ai[k] - bi[k];
+      }
+      break;
+    case EXPR_MUL:
+      // same order of operations as std::complex
+      for (size_t k = 0; k < n; k++) {
+        const double r = ar[k] * br[k] - ai[k] * bi[k];
+        const double i = ar[k] * bi[k] + ai[k] * br[k];
+        dr[k] = r;
+        di[k] = i;
+      }
+      break;
+    case EXPR_DIV:
+      for (size_t k = 0; k < n; k++) {
+        const double d = br[k] * br[k] + bi[k] * bi[k];
+        const double r = (ar[k] * br[k] + ai[k] * bi[k]) / d;
+        const double i = (ai[k] * br[k] - ar[k] * bi[k]) / d;
+        dr[k] = r;
+        di[k] = i;
+      }
+      break;
+    case EXPR_NEG:
+      for (size_t k = 0; k < n; k++) {
+        dr[k] = -ar[k];
+        di[k] = -ai[k];
+      }
+      break;
+    case EXPR_SQR:
+      // same as EXPR_MUL with both operands the same
+      for (size_t k = 0; k < n; k++) {
+        const double t = ar[k] * ai[k];
+        const double r = ar[k] * ar[k] - ai[k] * ai[k];
+        dr[k] = r;
+        di[k] = t + t;
+      }
+      break;
+    case EXPR_COPY:
+      for (size_t k = 0; k < n; k++) {
+        dr[k] = ar[k];
+        di[k] = ai[k];
+      }
+      break;
+  }
+}
+
+/** register r of sample k is at r * stride + k */
+static void run_program(const expression_program &program, double *re, double *im,
+                        const size_t stride, const size_t n) {
+  for (const expression_instruction &ins : program.code) {
+    run_op(ins.op, re + ins.a * stride, im + ins.a * stride, re + ins.b * stride,
+           im + ins.b * stride, re + ins.dst * stride, im + ins.dst * stride, n);
+  }
+}
+
+static void load_constants(const expression_program &program, double *re, double *im,
+                           const size_t stride) {
+  for (const expression_constant &k : program.constants) {
+    std::fill(re + k.reg * stride, re + (k.reg + 1) * stride, k.value.real());
+    std::fill(im + k.reg * stride, im + (k.reg + 1) * stride, k.value.imag());
+  }
+}
+
+complex evaluate_expression(const expression_program &program, const complex z, const complex c) {
+  std::vector<double> re(program.n_registers, 0), im(program.n_registers, 0);
+  load_constants(program, re.data(), im.data(), 1);
+  re[0] = z.real();
+  im[0] = z.imag();
+  re[1] = c.real();
+  im[1] = c.imag();
+  run_program(program, re.data(), im.data(), 1, 1);
+  return complex(re[0], im[0]);
+}
+
+bool is_custom_polynomial(const std::string &poly) {
+  return !poly.empty() && polynomial_names.find(poly) == polynomial_names.end();
+}
+
+///////////////////////////////////////////////////////////////////
+
+namespace {
+
+/* a value while compiling: either known already, or in a register */
+struct operand {
+  bool is_const;
+  /* temporaries go back to the free list once they are used */
+  bool is_temp;
+  complex value;
+  uint16_t reg;
+};
+
+/**
+ * recursive descent, emitting code on the way. operations on two constants are done right away,
+ * with the same arithmetic as the interpreter
+ */
+class expression_compiler {
+ public:
+  explicit expression_compiler(const std::string &expr) : s(expr) {}
+
+  expression_program compile() {
+    const operand result = parse_sum();
+    skip_space();
+    if (pos != s.size()) {
+      fail(std::string("unexpected '") + s[pos] + "'");
+    }
+    if (!result.is_const && result.reg == 0) {
+      // z -> z
+    } else if (result.is_temp && program.code.back().dst == result.reg) {
+      // nothing reads the result after the last instruction, so it can go straight to z
+      program.code.back().dst = 0;
+    } else {
+      const uint16_t r = load(result);
+      program.code.push_back({EXPR_COPY, 0, r, r});
+    }
+    return program;
+  }
+
+ private:
+  const std::string &s;
+  size_t pos = 0;
+  expression_program program;
+  std::vector<uint16_t> free_temps;
+  /* largest power allowed after ^ */
+  static const long max_power = 64;
+
+  void fail(const std::string &message) const {
+    throw std::runtime_error("polynomial \"" + s + "\": " + message + " at position " +
+                             std::to_string(pos));
+  }
+
+  void skip_space() {
+    while (pos < s.size() && std::isspace(static_cast<unsigned char>(s[pos]))) {
+      pos++;
+    }
+  }
+
+  bool accept(const char ch) {
+    skip_space();
+    if (pos < s.size() && s[pos] == ch) {
+      pos++;
+      return true;
+    }
+    return false;
+  }
+
+  static operand constant(const complex value) { return operand{true, false, value, 0}; }
+
+  uint16_t new_register() {
+    if (program.n_registers > UINT16_MAX) {
+      fail("expression is too long");
+    }
+    return uint16_t(program.n_registers++);
+  }
+
+  /** the register holding x, giving constants one the first time they are used */
+  uint16_t load(const operand &x) {
+    if (!x.is_const) {
+      return x.reg;
+    }
+    for (const expression_constant &k : program.constants) {
+      if (k.value == x.value) {
+        return k.reg;
+      }
+    }
+    const uint16_t r = new_register();
+    program.constants.push_back({r, x.value});
+    return r;
+  }
+
+  void release(const operand &x) {
+    if (x.is_temp) {
+      free_temps.push_back(x.reg);
+    }
+  }
+
+  static complex fold(const expression_op op, const complex a, const complex b) {
+    const double ar = a.real(), ai = a.imag(), br = b.real(), bi = b.imag();
+    double dr, di;
+    run_op(op, &ar, &ai, &br, &bi, &dr, &di, 1);
+    return complex(dr, di);
+  }
+
+  /** a op b. the operands are released unless asked not to, for values that are used again */
+  operand emit(const expression_op op, const operand &a, const operand &b,
+               const bool release_a = true, const bool release_b = true) {
+    if (a.is_const && b.is_const) {
+      return constant(fold(op, a.value, b.value));
+    }
+    const uint16_t ra = load(a);
+    const uint16_t rb = load(b);
+    uint16_t dst;
+    if (free_temps.empty()) {
+      dst = new_register();
+    } else {
+      dst = free_temps.back();
+      free_temps.pop_back();
+    }
+    program.code.push_back({op, dst, ra, rb});
+    if (release_a) {
+      release(a);
+    }
+    if (release_b && !(release_a && a.is_temp && b.is_temp && a.reg == b.reg)) {
+      release(b);
+    }
+    return operand{false, true, complex(), dst};
+  }
+
+  /** x^n for n >= 1 by squaring. x stays valid, and is returned as is for n == 1 */
+  operand power(const operand &x, const long n) {
+    if (n == 1) {
+      return x;
+    }
+    const operand half = power(x, n / 2);
+    const operand square = emit(EXPR_SQR, half, half, n / 2 != 1, false);
+    if (n % 2 == 1) {
+      return emit(EXPR_MUL, square, x, true, false);
+    }
+    return square;
+  }
+
+  // sum := product (('+' | '-') product)*
+  operand parse_sum() {
+    operand x = parse_product();
+    while (true) {
+      if (accept('+')) {
+        const operand y = parse_product();
+        x = emit(EXPR_ADD, x, y);
+      } else if (accept('-')) {
+        const operand y = parse_product();
+        x = emit(EXPR_SUB, x, y);
+      } else {
+        return x;
+      }
+    }
+  }
+
+  // product := unary (('*' | '/') unary)*
+  operand parse_product() {
+    operand x = parse_unary();
+    while (true) {
+      if (accept('*')) {
+        const operand y = parse_unary();
+        x = emit(EXPR_MUL, x, y);
+      } else if (accept('/')) {
+        const operand y = parse_unary();
+        x = emit(EXPR_DIV, x, y);
+      } else {
+        return x;
+      }
+    }
+  }
+
+  // unary := '-' unary | power
+  operand parse_unary() {
+    if (accept('-')) {
+      const operand x = parse_unary();
+      return emit(EXPR_NEG, x, x, true, false);
+    }
+    return parse_power();
+  }
+
+  // power := atom ('^' '-'? integer)?
+  operand parse_power() {
+    const operand x = parse_atom();
+    if (!accept('^')) {
+      return x;
+    }
+    const bool negative = accept('-');
+    skip_space();
+    if (pos >= s.size() || !std::isdigit(static_cast<unsigned char>(s[pos]))) {
+      fail("expected an integer power");
+    }
+    long n = 0;
+    while (pos < s.size() && std::isdigit(static_cast<unsigned char>(s[pos]))) {
+      n = n * 10 + (s[pos] - '0');
+      if (n > max_power) {
+        fail("power is too large");
+      }
+      pos++;
+    }
+    if (n == 0) {
+      release(x);
+      return constant(complex(1, 0));
+    }
+    const operand p = power(x, n);
+    if (n != 1) {
+      release(x);
+    }
+    if (negative) {
+      return emit(EXPR_DIV, constant(complex(1, 0)), p);
+    }
+    return p;
+  }
+
+  // atom := number | number 'i' | 'z' | 'c' | 'i' | '(' sum ')'
+  operand parse_atom() {
+    skip_space();
+    if (pos >= s.size()) {
+      fail("unexpected end");
+    }
+    const char ch = s[pos];
+    if (ch == '(') {
+      pos++;
+      const operand x = parse_sum();
+      if (!accept(')')) {
+        fail("expected ')'");
+      }
+      return x;
+    }
+    if (std::isdigit(static_cast<unsigned char>(ch)) || ch == '.') {
+      const char *start = s.c_str() + pos;
+      char *end;
+      const double value = std::strtod(start, &end);
+      if (end == start) {
+        fail("expected a number");
+      }
+      pos += end - start;
+      if (pos < s.size() && s[pos] == 'i' &&
+          (pos + 1 == s.size() || !std::isalnum(static_cast<unsigned char>(s[pos + 1])))) {
+        pos++;
+        return constant(complex(0, value));
+      }
+      return constant(complex(value, 0));
+    }
+    if (std::isalpha(static_cast<unsigned char>(ch))) {
+      size_t end = pos;
+      while (end < s.size() && (std::isalnum(static_cast<unsigned char>(s[end])) || s[end] == '_')) {
+        end++;
+      }
+      const std::string name = s.substr(pos, end - pos);
+      if (name == "z") {
+        pos = end;
+        return operand{false, false, complex(), 0};
+      } else if (name == "c") {
+        pos = end;
+        return operand{false, false, complex(), 1};
+      } else if (name == "i") {
+        pos = end;
+        return constant(complex(0, 1));
+      }
+      fail("unknown name '" + name + "'");
+    }
+    fail(std::string("unexpected '") + ch + "'");
+    return constant(complex());
+  }
+};
+}
+
+expression_program compile_expression(const std::string &expr) {
+  return expression_compiler(expr).compile();
+}
+
+///////////////////////////////////////////////////////////////////
+
+/* samples iterated side by side by one thread */
+static const size_t expression_batch = 64;
+
+/* pixels handed to a thread at a time */
+static const size_t expression_block_pixels = 256;
+
+complex fractal_expression::index_to_complex(const vec_ull &pos) {
+  return complex((pos[0] * 1.0 / iterations.x()) * (bounds[1] - bounds[0]) + bounds[0],
+                 bounds[3] - (pos[1] * 1.0 / iterations.y()) * (bounds[3] - bounds[2]));
+}
+
+void fractal_expression::set_zoom(const vec2 &center, const double &zoom) {
+  bounds = fractal_impl<double>::calc_bounds(iterations.x(), iterations.y(), center, zoom);
+  auto wid = fractal_impl<double>::calc_pixel_widths(iterations.x(), iterations.y(), zoom);
+  pixel_width_x = wid[0];
+  pixel_width_y = wid[1];
+  // same as fractal_impl
+  const double eps = std::min(pixel_width_x, pixel_width_y) / double(1000);
+  periodicity_eps2 = eps * eps;
+}
+
+void fractal_expression::read_config(const fractal_info &cfg) {
+  fractal::read_config(cfg);
+  if (cfg.bits != 64) {
+    throw std::runtime_error("custom polynomials only run in double precision");
+  }
+  if (cfg.perturbation) {
+    throw std::runtime_error("perturbation only supports the standard polynomial");
+  }
+  if (cfg.distance) {
+    throw std::runtime_error("custom polynomials don't support distance estimates");
+  }
+  program = compile_expression(cfg.poly);
+  pixel_width_x = 2.0 / double(cfg.x);
+  pixel_width_y = 2.0 / double(cfg.y);
+  set_zoom(cfg.r, cfg.i, cfg.zoom);
+  c = complex(numeric_from_string<double>(cfg.cr), numeric_from_string<double>(cfg.ci));
+}
+
+void fractal_expression::run_singlethread() {
+  run_expression(false);
+  if (do_sine_transform) {
+    log_transform(iterations);
+    sine_transform(iterations, mul);
+  }
+}
+
+void fractal_expression::run_multithread() {
+  run_expression(true);
+  if (do_sine_transform) {
+    log_transform(iterations);
+    sine_transform(iterations, mul);
+  }
+}
+
+/**
+ * the same rectangles as fractal_impl::run_rectangles_multithread, one level of splitting at a
+ * time: the unknown edge pixels of every rectangle in the level are iterated together, and then each
+ * rectangle is filled or split exactly like fractal_impl::process_rectangle does
+ */
+void fractal_expression::run_expression(const bool parallel) {
+  const size_t w = iterations.x(), h = iterations.y();
+  std::fill(iterations.begin(), iterations.end(), NOT_DEFINED);
+  std::vector<unsigned char> queued(iterations.size(), 0);
+  std::vector<rectangle> level = {
+      rectangle(0, w / 2, 0, h / 2),
+      rectangle(w / 2, w - 1, 0, h / 2),
+      rectangle(0, w / 2, h / 2, h - 1),
+      rectangle(w / 2, w - 1, h / 2, h - 1),
+  };
+  std::vector<rectangle> next_level;
+  std::vector<size_t> pixels;
+  size_t n_iterated = 0;
+
+  while (!level.empty()) {
+    pixels.clear();
+    auto queue = [&](const size_t x, const size_t y) {
+      const size_t p = x + y * w;
+      if (!queued[p]) {
+        queued[p] = 1;
+        pixels.push_back(p);
+      }
+    };
+    for (const rectangle &r : level) {
+      for (size_t x = r.xmin; x <= r.xmax; x++) {
+        queue(x, r.ymin);
+        queue(x, r.ymax);
+      }
+      for (size_t y = r.ymin; y <= r.ymax; y++) {
+        queue(r.xmin, y);
+        queue(r.xmax, y);
+      }
+    }
+    iterate_pixels(pixels, parallel);
+    n_iterated += pixels.size();
+
+    next_level.clear();
+    for (const rectangle &r : level) {
+      // every side has to be the same as its first pixel
+      bool edges_equal = true;
+      for (size_t x = r.xmin; x <= r.xmax; x++) {
+        edges_equal = edges_equal && cell(x, r.ymin) == cell(r.xmin, r.ymin) &&
+                      cell(x, r.ymax) == cell(r.xmin, r.ymax);
+      }
+      for (size_t y = r.ymin; y <= r.ymax; y++) {
+        edges_equal = edges_equal && cell(r.xmin, y) == cell(r.xmin, r.ymin) &&
+                      cell(r.xmax, y) == cell(r.xmax, r.ymin);
+      }
+      const size_t shortest_edge = std::min(r.xmax - r.xmin, r.ymax - r.ymin);
+      if (edges_equal) {
+        const double fill = cell(r.xmin, r.ymin);
+        for (size_t y = r.ymin; y <= r.ymax; y++) {
+          for (size_t x = r.xmin; x <= r.xmax; x++) {
+            cell(x, y) = fill;
+          }
+        }
+      } else if (shortest_edge > 1) {
+        const size_t xmid = (r.xmin + r.xmax) / 2, ymid = (r.ymin + r.ymax) / 2;
+        next_level.push_back(rectangle(r.xmin, xmid, r.ymin, ymid));
+        next_level.push_back(rectangle(xmid, r.xmax, r.ymin, ymid));
+        next_level.push_back(rectangle(r.xmin, xmid, ymid, r.ymax));
+        next_level.push_back(rectangle(xmid, r.xmax, ymid, r.ymax));
+      }
+    }
+    level.swap(next_level);
+  }
+  iterated_pixels = n_iterated;
+  filled_pixels = iterations.size() - n_iterated;
+}
+
+/**
+ * same as fractal_impl::iterate_cell for each of the pixels (as x + y * width), without the cardioid
+ * test. each thread keeps expression_batch samples in flight, and as soon as one of them is done its
+ * lane starts on the next sample of the block, so the batch stays full until the end of the block
+ */
+void fractal_expression::iterate_pixels(const std::vector<size_t> &pixels, const bool parallel) {
+  const size_t B = expression_batch;
+  const size_t w = iterations.x();
+  const size_t n_pixels = pixels.size();
+  const size_t samples_per_pixel = subsample ? 4 : 1;
+  const size_t n_blocks = (n_pixels + expression_block_pixels - 1) / expression_block_pixels;
+  const double cap = double(max_iterations) * double(max_iterations);
+  const bool periodicity = check_interior;
+  // nothing is closer than 0 without periodicity checking
+  const double eps2 = periodicity ? periodicity_eps2 : 0;
+  const double offset_r[] = {-pixel_width_x, pixel_width_x, 0, 0};
+  const double offset_i[] = {0, 0, -pixel_width_y, pixel_width_y};
+
+#pragma omp parallel if (parallel)
+  {
+    std::vector<double> re(program.n_registers * B, 0), im(program.n_registers * B, 0);
+    load_constants(program, re.data(), im.data(), B);
+    double *zr = re.data(), *zi = im.data();
+    double *cr = re.data() + B, *ci = im.data() + B;
+    double samples[4 * expression_block_pixels];
+    /*
+     * state of each lane: its sample, the step it started at and the step it runs out of
+     * iterations, and brent's algorithm. everything the check after each step reads is 64 bits
+     * wide, so that loop vectorizes
+     */
+    size_t sample[expression_batch], start[expression_batch], finish[expression_batch];
+    uint64_t period[expression_batch], refresh[expression_batch];
+    /* the next step the lane needs attention without escaping: finish or refresh */
+    uint64_t event[expression_batch];
+    double saved_r[expression_batch], saved_i[expression_batch];
+    /* all ones for lanes with a sample */
+    uint64_t live[expression_batch];
+    /* 1: escaped, 2: cycle, 4: event */
+    uint64_t flags[expression_batch];
+
+#pragma omp for schedule(dynamic, 1)
+    for (size_t block = 0; block < n_blocks; block++) {
+      const size_t first = block * expression_block_pixels;
+      const size_t count = std::min(expression_block_pixels, n_pixels - first);
+      const size_t n_samples = count * samples_per_pixel;
+      size_t next = 0;
+      uint64_t step = 0;
+
+      // start the next sample of the block in lane k, false if there are none left
+      auto load_lane = [&](const size_t k) {
+        while (next < n_samples) {
+          const size_t s = next++;
+          if (max_iterations == 0) {
+            samples[s] = 0.0;
+            continue;
+          }
+          const size_t p = pixels[first + s / samples_per_pixel];
+          complex pos = index_to_complex(vec_ull{p % w, p / w});
+          if (subsample) {
+            pos = pos + complex(offset_r[s % 4], offset_i[s % 4]);
+          }
+          if (is_julia) {
+            zr[k] = pos.real();
+            zi[k] = pos.imag();
+            cr[k] = c.real();
+            ci[k] = c.imag();
+          } else {
+            zr[k] = zi[k] = 0;
+            cr[k] = pos.real();
+            ci[k] = pos.imag();
+          }
+          sample[k] = s;
+          start[k] = step;
+          finish[k] = step + max_iterations;
+          period[k] = 1;
+          refresh[k] = periodicity ? step + 1 : SIZE_MAX;
+          event[k] = std::min(finish[k], refresh[k]);
+          saved_r[k] = zr[k];
+          saved_i[k] = zi[k];
+          live[k] = ~uint64_t(0);
+          return true;
+        }
+        // never read, but keeps the idle lanes from computing on garbage
+        zr[k] = zi[k] = cr[k] = ci[k] = saved_r[k] = saved_i[k] = 0;
+        live[k] = 0;
+        return false;
+      };
+
+      size_t n_live = 0;
+      for (size_t k = 0; k < B; k++) {
+        n_live += load_lane(k);
+      }
+      /* lanes in use, less than B once the block runs out of samples */
+      size_t active = B;
+      while (n_live > 0) {
+        run_program(program, re.data(), im.data(), B, active);
+        step++;
+        uint64_t any = 0;
+#pragma omp simd reduction(| : any)
+        for (size_t k = 0; k < active; k++) {
+          const double n = zr[k] * zr[k] + zi[k] * zi[k];
+          const double dr = zr[k] - saved_r[k], di = zi[k] - saved_i[k];
+          const uint64_t f = uint64_t(n > cap) | (uint64_t(dr * dr + di * di < eps2) << 1) |
+                             (uint64_t(step == event[k]) << 2);
+          flags[k] = f & live[k];
+          any |= flags[k];
+        }
+        if (!any) {
+          continue;
+        }
+        for (size_t k = 0; k < active; k++) {
+          if (!flags[k]) {
+            continue;
+          }
+          double result = 0.0;
+          if (!(flags[k] & 3)) {
+            if (step != finish[k]) {
+              // the saved point moves after 1, 2, 4, 8... more steps, as in fractal_cell
+              saved_r[k] = zr[k];
+              saved_i[k] = zi[k];
+              period[k] *= 2;
+              refresh[k] = step + period[k];
+              event[k] = std::min(finish[k], refresh[k]);
+              continue;
+            }
+          } else if (!(flags[k] & 2)) {
+            // the loop index of fractal_cell for this lane
+            const size_t i = step - 1 - start[k];
+            const double n = zr[k] * zr[k] + zi[k] * zi[k];
+            result = smooth ? i - log2(log2(n + 1) + 1) + 4.0 : double(i);
+          }
+          samples[sample[k]] = result;
+          if (!load_lane(k)) {
+            n_live--;
+          }
+        }
+        if (next == n_samples && n_live <= active / 2) {
+          // the last few samples of the block: move them to the front so the idle lanes aren't
+          // iterated any more
+          size_t j = 0;
+          for (size_t k = 0; k < active; k++) {
+            if (!live[k]) {
+              continue;
+            }
+            zr[j] = zr[k];
+            zi[j] = zi[k];
+            cr[j] = cr[k];
+            ci[j] = ci[k];
+            sample[j] = sample[k];
+            start[j] = start[k];
+            finish[j] = finish[k];
+            period[j] = period[k];
+            refresh[j] = refresh[k];
+            event[j] = event[k];
+            saved_r[j] = saved_r[k];
+            saved_i[j] = saved_i[k];
+            live[j] = live[k];
+            j++;
+          }
+          active = j;
+        }
+      }
+
+      for (size_t q = 0; q < count; q++) {
+        const size_t p = pixels[first + q];
+        const double *v = samples + q * samples_per_pixel;
+        cell(p % w, p / w) = subsample ? ((v[0] + v[1]) + (v[2] + v[3])) / 4 : v[0];
+      }
+    }
+  }
+}
+
+fractal_expression::fractal_expression(const size_t w, const size_t h) : fractal(w, h) {}
+
+fractal_expression::fractal_expression(const fractal_expression &rhs)
+    : fractal(rhs),
+      pixel_width_x(rhs.pixel_width_x),
+      pixel_width_y(rhs.pixel_width_y),
+      c(rhs.c),
+      program(rhs.program),
+      periodicity_eps2(rhs.periodicity_eps2),
+      bounds(rhs.bounds) {}
+
+fractal_ref get_fractal_expression(const fractal_info &cfg) {
+  fractal_ref ref = std::make_shared<fractal_expression>(cfg.x, cfg.y);
+  ref->read_config(cfg);
+  return ref;
+}
+};
@@ -0,0 +1,109 @@
+// (c) Copyright 2017 Josh Wright
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "fractal_common.h"
+
+/*
+ * custom polynomials: anything in fractal_info::poly that isn't one of the polynomial_names is read
+ * as an expression in z and c, for example "z^3 - z*c + c / (z^2 + 0.5i)". the expression is
+ * compiled once into instructions on numbered registers, and the interpreter runs each instruction
+ * over a whole batch of samples before moving on to the next one, so the cost of dispatching an
+ * instruction is shared by all of them and the inner loops are plain arrays the compiler can
+ * vectorize.
+ *
+ * the grammar is + - * / on complex numbers, unary minus, parentheses, integer powers (z^3,
+ * z^-2), real numbers, and i on its own or after a number (0.5i)
+ */
+
+namespace image_utils {
+
+enum expression_op : uint8_t {
+  EXPR_ADD,
+  EXPR_SUB,
+  EXPR_MUL,
+  EXPR_DIV,
+  EXPR_NEG,
+  EXPR_SQR,
+  EXPR_COPY,
+};
+
+/** dst = a op b, b is ignored by the unary operations */
+struct expression_instruction {
+  expression_op op;
+  uint16_t dst, a, b;
+};
+
+struct expression_constant {
+  uint16_t reg;
+  complex value;
+};
+
+/**
+ * register 0 holds z and register 1 holds c. the constants are loaded once, and registers that
+ * aren't either hold temporaries. running the code leaves the next z in register 0
+ */
+struct expression_program {
+  std::vector<expression_instruction> code;
+  std::vector<expression_constant> constants;
+  size_t n_registers = 2;
+};
+
+/** true if poly isn't empty or one of the polynomial_names */
+bool is_custom_polynomial(const std::string &poly);
+
+/** throws std::runtime_error with the position of the problem */
+expression_program compile_expression(const std::string &expr);
+
+/** one step of the program for a single point, mostly for testing */
+complex evaluate_expression(const expression_program &program, const complex z, const complex c);
+
+fractal_ref get_fractal_expression(const fractal_info &cfg);
+
+/**
+ * double precision fractal for a custom polynomial. the image is split into rectangles like
+ * fractal_impl does, and the results are exactly the same as fractal_impl when the expression does
+ * the same operations in the same order as one of the built in polynomials ("z^2 + c",
+ * "z*z*z + c"). division is the textbook formula, which can overflow where std::complex would scale
+ */
+class fractal_expression : public fractal {
+ public:
+  double pixel_width_x;
+  double pixel_width_y;
+  complex c = complex(0.0, 0.0);
+  expression_program program;
+  /* orbits this close (squared) to a previous point are cycles, same as fractal_impl */
+  double periodicity_eps2 = 0;
+
+ protected:
+  vec4 bounds;
+
+ public:
+  complex index_to_complex(const vec_ull &pos);
+
+  /////////////////////////////////////////////////////////////////////////////
+
+  virtual void run_singlethread();
+  virtual void run_multithread();
+  void run_expression(const bool parallel);
+  /** raw iterations of the pixels (x + y * width) */
+  void iterate_pixels(const std::vector<size_t> &pixels, const bool parallel);
+
+  /////////////////////////////////////////////////////////////////////////////
+
+  fractal_expression(const size_t w, const size_t h);
+
+  fractal_expression(const fractal_expression &rhs);
+
+  virtual void read_config(const fractal_info &cfg);
+
+  virtual void set_zoom(const std::string &r_str, const std::string &i_str,
+                        const std::string &zoom_str) {
+    set_zoom(vec2{numeric_from_string<double>(r_str), numeric_from_string<double>(i_str)},
+             numeric_from_string<double>(zoom_str));
+  }
+
+  void set_zoom(const vec2 &center, const double &zoom);
+};
+};
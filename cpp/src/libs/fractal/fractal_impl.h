@@ -1,4 +1,9 @@
 #pragma once
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
 #include "fractal_common.h"
 #include "util/debug.h"
 
@@ -44,17 +49,50 @@ class fractal_impl : public fractal {
     };
   }
 
+  /**
+   * points inside the set never escape, so they would always run to max_iterations. the bulk of
+   * the standard mandelbrot set is found without iterating, and for everything else the orbit is
+   * compared with a saved point (Brent's algorithm: the saved point moves to the current one after
+   * 1, 2, 4, 8... iterations). an orbit that comes back to within a small fraction of a pixel of
+   * itself has settled into a cycle and is reported as inside
+   *
+   * the loop works on the real and imaginary parts directly (see polynomial_step), so the squares
+   * computed for the bailout are reused by the next step instead of being computed again
+   */
   template <bool smooth>
   double fractal_cell_(const complex &_z, const complex &c, const size_t max_iterations) {
     const numeric cap = numeric(max_iterations) * numeric(max_iterations);
-    complex z = _z;
+    if (check_interior && !is_julia && std::is_same<polynomial, func_standard<numeric>>::value &&
+        in_cardioid_or_bulb(c.real(), c.imag())) {
+      return double(0.0);
+    }
+    const numeric cr = c.real(), ci = c.imag();
+    numeric zr = _z.real(), zi = _z.imag();
+    numeric zr2 = zr * zr, zi2 = zi * zi;
+    numeric saved_r = zr, saved_i = zi;
+    size_t period = 1, steps = 0;
     for (size_t i = 0; i < max_iterations; i++) {
-      z = poly(z, c);
-      if (norm(z) > cap) {
+      polynomial_step<numeric, polynomial>::step(poly, zr, zi, cr, ci, zr2, zi2);
+      zr2 = zr * zr;
+      zi2 = zi * zi;
+      if (check_interior) {
+        const numeric dr = zr - saved_r, di = zi - saved_i;
+        if (dr * dr + di * di < periodicity_eps2) {
+          return double(0.0);
+        }
+        if (++steps == period) {
+          saved_r = zr;
+          saved_i = zi;
+          steps = 0;
+          period *= 2;
+        }
+      }
+      const numeric n = zr2 + zi2;
+      if (n > cap) {
         if (smooth) {
           // explicitly down-casting here is deemed to be fine because we'll be returning a double
           // anyway
-          return i - log2(log2(double(norm(z)) + 1) + 1) + 4.0;
+          return i - log2(log2(double(n) + 1) + 1) + 4.0;
         } else {
           return double(i);
         }
@@ -63,8 +101,58 @@ class fractal_impl : public fractal {
     return double(0.0);
   }
 
+  /**
+   * exterior distance estimate, in pixels. z is iterated together with its derivative (with
+   * respect to c, or to the starting point for julia sets) as a dual number, and a point that
+   * escapes is roughly 2 |z| log|z| / |z'| away from the set. 0 for points inside the set, with the
+   * same checks as fractal_cell_
+   */
+  double distance_cell(const complex &_z, const complex &c, const size_t max_iterations) {
+    typedef dual_complex<numeric> dual;
+    const numeric cap = numeric(max_iterations) * numeric(max_iterations);
+    if (check_interior && !is_julia && std::is_same<polynomial, func_standard<numeric>>::value &&
+        in_cardioid_or_bulb(c.real(), c.imag())) {
+      return double(0.0);
+    }
+    dual z(_z, is_julia ? complex(1, 0) : complex(0, 0));
+    const dual dc(c, is_julia ? complex(0, 0) : complex(1, 0));
+    complex saved = z.v;
+    size_t period = 1, steps = 0;
+    for (size_t i = 0; i < max_iterations; i++) {
+      z = poly(z, dc);
+      const numeric zr = z.v.real(), zi = z.v.imag();
+      if (check_interior) {
+        const numeric dr = zr - saved.real(), di = zi - saved.imag();
+        if (dr * dr + di * di < periodicity_eps2) {
+          return double(0.0);
+        }
+        if (++steps == period) {
+          saved = z.v;
+          steps = 0;
+          period *= 2;
+        }
+      }
+      const numeric n = zr * zr + zi * zi;
+      if (n > cap) {
+        const numeric nd = z.d.real() * z.d.real() + z.d.imag() * z.d.imag();
+        if (nd == 0) {
+          // only at critical points, which don't escape in the first place
+          return double(0.0);
+        }
+        // 2 log|z| = log(n), and a pixel is twice pixel_width
+        const numeric pixel = numeric(2) * std::min(pixel_width_x, pixel_width_y);
+        const numeric d = sqrt(n / nd) / pixel;
+        return double(d) * log(double(n));
+      }
+    }
+    return double(0.0);
+  }
+
   double fractal_cell(const complex &z, const complex &c, const size_t max_iter,
                       const bool smooth) {
+    if (distance_estimate) {
+      return distance_cell(z, c, max_iter);
+    }
     if (smooth) {
       return fractal_cell_<true>(z, c, max_iter);
     } else {
@@ -89,17 +177,98 @@ class fractal_impl : public fractal {
       }
       return ((out[0] + out[1]) + (out[2] + out[3])) / 4;
     } else {
-      if (is_julia) {
-        return fractal_cell(pos, c, max_iterations, smooth);
-      } else {
-        return fractal_cell(complex(0, 0), pos, max_iterations, smooth);
+      return sample_cell(pos);
+    }
+  }
+
+  /** a single point, without subsampling */
+  double sample_cell(const complex pos) {
+    if (is_julia) {
+      return fractal_cell(pos, c, max_iterations, smooth);
+    } else {
+      return fractal_cell(complex(0, 0), pos, max_iterations, smooth);
+    }
+  }
+
+  /** neighbors that are far enough apart to get more samples */
+  bool needs_antialiasing(const double a, const double b) const {
+    if ((a == 0) != (b == 0)) {
+      // edge of the set
+      return true;
+    }
+    return std::abs(log2(a + 1) - log2(b + 1)) > aa_threshold;
+  }
+
+  /**
+   * adaptive antialiasing: pixels that differ too much from one of their neighbors are replaced by
+   * the average of their own sample and aa_samples jittered samples spread over the pixel, and all
+   * other pixels keep their single sample.
+   *
+   * the samples are an R2 sequence (a 2d golden ratio sequence), shifted by a random offset per pixel
+   */
+  void antialias(const bool parallel) {
+    antialiased_pixels = 0;
+    if (aa_samples == 0) {
+      return;
+    }
+    const size_t w = iterations.x(), h = iterations.y();
+    // decide everything before changing anything, so the order doesn't matter
+    std::vector<size_t> marked;
+#pragma omp parallel if (parallel)
+    {
+      std::vector<size_t> local;
+#pragma omp for schedule(static) nowait
+      for (size_t y = 0; y < h; y++) {
+        for (size_t x = 0; x < w; x++) {
+          const double v = cell(x, y);
+          if ((x > 0 && needs_antialiasing(v, cell(x - 1, y))) ||
+              (x + 1 < w && needs_antialiasing(v, cell(x + 1, y))) ||
+              (y > 0 && needs_antialiasing(v, cell(x, y - 1))) ||
+              (y + 1 < h && needs_antialiasing(v, cell(x, y + 1)))) {
+            local.push_back(x + y * w);
+          }
+        }
+      }
+#pragma omp critical
+      marked.insert(marked.end(), local.begin(), local.end());
+    }
+    std::vector<double> values(marked.size());
+
+#pragma omp parallel for schedule(dynamic, 16) if (parallel)
+    for (size_t m = 0; m < marked.size(); m++) {
+      const size_t x = marked[m] % w, y = marked[m] / w;
+      const complex pos = index_to_complex(vec_ull{x, y});
+      // per pixel offset of the sequence, from an integer hash
+      uint64_t hash = (x * 0x9e3779b97f4a7c15ull) ^ (y * 0xc2b2ae3d27d4eb4full);
+      hash = (hash ^ (hash >> 31)) * 0xbf58476d1ce4e5b9ull;
+      hash ^= hash >> 29;
+      const double offset_x = (hash & 0xffffffff) / 4294967296.0;
+      const double offset_y = (hash >> 32) / 4294967296.0;
+      double sum = cell(x, y);
+      for (size_t s = 0; s < aa_samples; s++) {
+        double u = s * 0.7548776662466927 + offset_x;
+        double v = s * 0.5698402909980532 + offset_y;
+        u -= std::floor(u);
+        v -= std::floor(v);
+        // the same area as subsample covers: a pixel centered on the pixel's own sample
+        sum += sample_cell(pos + complex(numeric((2 * u - 1)) * pixel_width_x,
+                                         numeric((2 * v - 1)) * pixel_width_y));
       }
+      values[m] = sum / (aa_samples + 1);
+    }
+    for (size_t m = 0; m < marked.size(); m++) {
+      cell(marked[m] % w, marked[m] / w) = values[m];
     }
+    antialiased_pixels = marked.size();
   }
 
  public:
   numeric pixel_width_x;
   numeric pixel_width_y;
+  /* pixels calculated in this run, the rest were filled in. each task adds its count once */
+  std::atomic<size_t> cells_iterated{0};
+  /* orbits this close (squared) to a previous point are cycles */
+  numeric periodicity_eps2 = 0;
   complex c = complex(0.0, 0.0);
 
  protected:
@@ -107,7 +276,7 @@ class fractal_impl : public fractal {
   vec4 bounds;
 
  public:
-  bool process_line(const line &l) {
+  bool process_line(const line &l, size_t &n_iterated) {
     const vec_ull start = l.start_point;
     const vec_ull end = l.end_point;
     // handle lines containing only a single pixel
@@ -117,23 +286,25 @@ class fractal_impl : public fractal {
 
     for (size_t i = 0; i <= length; i++) {
       vec_ull pos = start + diff * i;
-      if (iterations(pos) == NOT_DEFINED) {
+      double &value = cell(pos[0], pos[1]);
+      if (value == NOT_DEFINED) {
         // imaginary axis is different because it points opposite our +y axis
         complex complex_pos = index_to_complex(pos);
-        iterations(pos) = iterate_cell(complex_pos);
+        value = iterate_cell(complex_pos);
+        n_iterated++;
       }
-      if (iterations(pos) != iterations(start)) {
+      if (value != cell(start[0], start[1])) {
         out = false;
       }
     }
     return out;
   }
 
-  split_rectangle process_rectangle(rectangle r) {
+  split_rectangle process_rectangle(rectangle r, size_t &n_iterated) {
     bool edges_equal = true;
     for (auto &side : r.get_sides()) {
       // pre-calculate to avoid lazy evaluation skipping
-      bool res = process_line(side);
+      bool res = process_line(side, n_iterated);
       edges_equal = edges_equal && res;
     }
     size_t shortest_edge = std::min(r.xmax - r.xmin, r.ymax - r.ymin);
@@ -151,10 +322,10 @@ class fractal_impl : public fractal {
           },
       };
     } else if (edges_equal /*&& shortest_edge < longest_bound / 2*/) {
-      numeric iter_fill = iterations(r.xmin, r.ymin);
+      numeric iter_fill = cell(r.xmin, r.ymin);
       for (size_t i = r.xmin; i <= r.xmax; i++) {
         for (size_t j = r.ymin; j <= r.ymax; j++) {
-          iterations(i, j) = double(iter_fill);
+          cell(i, j) = double(iter_fill);
         }
       }
       if (do_grid) {
@@ -180,60 +351,184 @@ class fractal_impl : public fractal {
 
   /////////////////////////////////////////////////////////////////////////////
 
-  virtual void run_multithread() {
-    std::fill(iterations.begin(), iterations.end(), NOT_DEFINED);
-    const size_t stack_size = iterations.x() * iterations.y();
-    std::vector<rectangle> rectange_stack;
-    // four quadrants for starting
-    rectange_stack.push_back(rectangle(0, iterations.x() / 2, 0, iterations.y() / 2));
-    rectange_stack.push_back(
-        rectangle(iterations.x() / 2, iterations.x() - 1, 0, iterations.y() / 2));
-    rectange_stack.push_back(
-        rectangle(0, iterations.x() / 2, iterations.y() / 2, iterations.y() - 1));
-    rectange_stack.push_back(
-        rectangle(iterations.x() / 2, iterations.x() - 1, iterations.y() / 2, iterations.y() - 1));
+  /* rectangles with less area than this are split by the thread that found them */
+  static const size_t task_min_area = 32 * 32;
+
+  /**
+   * split r until the edges agree, handing the big sub-rectangles out as tasks. there is no
+   * synchronization between the tasks: neighbors only share edges, and any pixel that two of them
+   * both calculate gets the same value
+   */
+  void process_rectangle_task(const rectangle &r) {
+    rectangle_stack stack(64);
+    stack.push(r);
+    size_t n_iterated = 0;
+    while (!stack.empty()) {
+      split_rectangle sp = process_rectangle(stack.pop(), n_iterated);
+      if (!sp.did_split) {
+        continue;
+      }
+      for (size_t k = 0; k < 4; k++) {
+        const rectangle sub = sp.rectangles[k];
+        if ((sub.xmax - sub.xmin) * (sub.ymax - sub.ymin) >= task_min_area) {
+#pragma omp task firstprivate(sub)
+          process_rectangle_task(sub);
+        } else {
+          stack.push(sub);
+        }
+      }
+    }
+    cells_iterated += n_iterated;
+  }
 
-    rectange_stack.reserve(stack_size);
-    while (!rectange_stack.empty()) {
-      std::vector<rectangle> new_stack;
-      new_stack.reserve(stack_size);
-#pragma omp parallel for schedule(dynamic)
-      for (size_t i = 0; i < rectange_stack.size(); i++) {
-        auto v = process_rectangle(rectange_stack[i]);
+  /////////////////////////////////////////////////////////////////////////////
 
-        if (v.did_split) {
-#pragma omp critical
-          {
-            new_stack.push_back(v.rectangles[0]);
-            new_stack.push_back(v.rectangles[1]);
-            new_stack.push_back(v.rectangles[2]);
-            new_stack.push_back(v.rectangles[3]);
-          }
+  /* square tiles that are border traced independently */
+  static const size_t trace_tile_size = 64;
+
+  /**
+   * border tracing of one tile, treating the edges of the tile as the edges of the image.
+   *
+   * starting from the edges, every pixel on the queue is calculated along with its 4 neighbors.
+   * neighbors with a different value are on the border of a region, so they are queued in turn,
+   * along with the diagonals next to them. once the queue is empty every region of equal value
+   * is enclosed by calculated pixels, and everything left is filled from the pixel to its left
+   */
+  void trace_tile(const rectangle &t, size_t &n_iterated) {
+    const size_t w = t.xmax - t.xmin + 1;
+    const size_t h = t.ymax - t.ymin + 1;
+    enum { LOADED = 1, QUEUED = 2 };
+    std::vector<unsigned char> state(w * h, 0);
+    std::vector<size_t> queue;
+    queue.reserve(2 * (w + h));
+
+    auto load = [&](const size_t p) {
+      const vec_ull pos{t.xmin + p % w, t.ymin + p / w};
+      double &value = cell(pos[0], pos[1]);
+      if (!(state[p] & LOADED)) {
+        value = iterate_cell(index_to_complex(pos));
+        state[p] |= LOADED;
+        n_iterated++;
+      }
+      return value;
+    };
+    auto enqueue = [&](const size_t p) {
+      if (!(state[p] & QUEUED)) {
+        state[p] |= QUEUED;
+        queue.push_back(p);
+      }
+    };
+
+    for (size_t x = 0; x < w; x++) {
+      enqueue(x);
+      enqueue(x + (h - 1) * w);
+    }
+    for (size_t y = 1; y + 1 < h; y++) {
+      enqueue(y * w);
+      enqueue(y * w + w - 1);
+    }
+
+    while (!queue.empty()) {
+      const size_t p = queue.back();
+      queue.pop_back();
+      const double center = load(p);
+      const size_t x = p % w;
+      const size_t y = p / w;
+      const bool ll = x > 0, rr = x + 1 < w, uu = y > 0, dd = y + 1 < h;
+      // pre-calculate to avoid lazy evaluation skipping
+      const bool l = ll && load(p - 1) != center;
+      const bool r = rr && load(p + 1) != center;
+      const bool u = uu && load(p - w) != center;
+      const bool d = dd && load(p + w) != center;
+      if (l) enqueue(p - 1);
+      if (r) enqueue(p + 1);
+      if (u) enqueue(p - w);
+      if (d) enqueue(p + w);
+      if (uu && ll && (l || u)) enqueue(p - w - 1);
+      if (uu && rr && (r || u)) enqueue(p - w + 1);
+      if (dd && ll && (l || d)) enqueue(p + w - 1);
+      if (dd && rr && (r || d)) enqueue(p + w + 1);
+    }
+
+    // the left column is always calculated
+    for (size_t y = 0; y < h; y++) {
+      for (size_t x = 1; x < w; x++) {
+        if (!(state[y * w + x] & LOADED)) {
+          cell(t.xmin + x, t.ymin + y) = cell(t.xmin + x - 1, t.ymin + y);
         }
       }
-      rectange_stack = new_stack;
     }
+  }
+
+  void trace_borders(const bool parallel) {
+    const size_t tiles_x = (iterations.x() + trace_tile_size - 1) / trace_tile_size;
+    const size_t tiles_y = (iterations.y() + trace_tile_size - 1) / trace_tile_size;
+    size_t n_iterated = 0;
+#pragma omp parallel for schedule(dynamic, 1) reduction(+ : n_iterated) if (parallel)
+    for (size_t k = 0; k < tiles_x * tiles_y; k++) {
+      const size_t x0 = (k % tiles_x) * trace_tile_size;
+      const size_t y0 = (k / tiles_x) * trace_tile_size;
+      trace_tile(rectangle(x0, std::min(x0 + trace_tile_size, iterations.x()) - 1, y0,
+                           std::min(y0 + trace_tile_size, iterations.y()) - 1),
+                 n_iterated);
+    }
+    cells_iterated += n_iterated;
+  }
+
+  /** fill in iterated_pixels and filled_pixels */
+  void record_stats() {
+    iterated_pixels = std::min(size_t(cells_iterated), iterations.size());
+    filled_pixels = iterations.size() - iterated_pixels;
+  }
+
+  /////////////////////////////////////////////////////////////////////////////
+
+  virtual void run_multithread() {
+    std::fill(iterations.begin(), iterations.end(), NOT_DEFINED);
+    cells_iterated = 0;
+    if (border_trace) {
+      trace_borders(true);
+    } else {
+      run_rectangles_multithread();
+    }
+    record_stats();
+    antialias(true);
 
     if (do_sine_transform) {
-      // iterations = iterations;
-      log_transform(iterations);
-      sine_transform(iterations, mul);
+      apply_transform();
     }
 
-    if (do_grid) {
+    if (do_grid && !border_trace) {
       /*get max iteration (that was used) and use that*/
       double grid_color = *std::max_element(iterations.begin(), iterations.end());
 #pragma omp parallel for schedule(static) collapse(2)
       for (size_t i = 0; i < iterations.x(); ++i) {
         for (size_t j = 0; j < iterations.y(); ++j) {
           if (grid_mask(i, j)) {
-            iterations(i, j) = grid_color;
+            cell(i, j) = grid_color;
           }
         }
       }
     }
   }
 
+  void run_rectangles_multithread() {
+    // four quadrants for starting
+    const rectangle quadrants[] = {
+        rectangle(0, iterations.x() / 2, 0, iterations.y() / 2),
+        rectangle(iterations.x() / 2, iterations.x() - 1, 0, iterations.y() / 2),
+        rectangle(0, iterations.x() / 2, iterations.y() / 2, iterations.y() - 1),
+        rectangle(iterations.x() / 2, iterations.x() - 1, iterations.y() / 2, iterations.y() - 1),
+    };
+#pragma omp parallel
+#pragma omp single
+    for (rectangle q : quadrants) {
+#pragma omp task firstprivate(q)
+      process_rectangle_task(q);
+    }
+    // all tasks are finished at the end of the parallel region
+  }
+
   /////////////////////////////////////////////////////////////////////////////
 
   void run_singlethread() {
@@ -243,15 +538,26 @@ class fractal_impl : public fractal {
 
   virtual void run_singlethread(rectangle_stack &stack) {
     std::fill(iterations.begin(), iterations.end(), NOT_DEFINED);
+    cells_iterated = 0;
+    if (border_trace) {
+      trace_borders(false);
+      record_stats();
+      antialias(false);
+      if (do_sine_transform) {
+        apply_transform();
+      }
+      return;
+    }
     stack.push_back(rectangle(0, iterations.x() / 2, 0, iterations.y() / 2));
     stack.push_back(rectangle(iterations.x() / 2, iterations.x() - 1, 0, iterations.y() / 2));
     stack.push_back(rectangle(0, iterations.x() / 2, iterations.y() / 2, iterations.y() - 1));
     stack.push_back(
         rectangle(iterations.x() / 2, iterations.x() - 1, iterations.y() / 2, iterations.y() - 1));
 
+    size_t n_iterated = 0;
     while (!stack.empty()) {
       rectangle current = stack.pop();
-      split_rectangle sp = process_rectangle(current);
+      split_rectangle sp = process_rectangle(current, n_iterated);
       if (sp.did_split) {
         stack.push(sp.rectangles[0]);
         stack.push(sp.rectangles[1]);
@@ -259,14 +565,26 @@ class fractal_impl : public fractal {
         stack.push(sp.rectangles[3]);
       }
     }
+    cells_iterated = n_iterated;
+    record_stats();
+    antialias(false);
     if (do_sine_transform) {
-      log_transform(iterations);
-      sine_transform(iterations, mul);
+      apply_transform();
     }
   }
 
   /////////////////////////////////////////////////////////////////////////////
 
+  virtual bool has_pixel_access() const { return true; }
+
+  virtual double iterate_pixel(const size_t x, const size_t y) {
+    return iterate_cell(index_to_complex(vec_ull{x, y}));
+  }
+
+  virtual void finish_pixels() { antialias(true); }
+
+  /////////////////////////////////////////////////////////////////////////////
+
   fractal_impl(const size_t w, const size_t h, polynomial poly = polynomial())
       : fractal(w, h), poly(poly) {}
 
@@ -276,11 +594,13 @@ class fractal_impl : public fractal {
       : fractal(rhs),
         pixel_width_x(rhs.pixel_width_x),
         pixel_width_y(rhs.pixel_width_y),
+        periodicity_eps2(rhs.periodicity_eps2),
         poly(rhs.poly),
         c(rhs.c) {}
 
   virtual void read_config(const fractal_info &cfg) {
     fractal::read_config(cfg);
+    layout = tile_layout(cfg.x, cfg.y, cfg.tile);
     pixel_width_x = 2.0 / numeric(cfg.x);
     pixel_width_y = 2.0 / numeric(cfg.y);
     set_zoom(cfg.r, cfg.i, cfg.zoom);
@@ -298,6 +618,9 @@ class fractal_impl : public fractal {
     auto wid = calc_pixel_widths(iterations.x(), iterations.y(), zoom);
     pixel_width_x = wid[0];
     pixel_width_y = wid[1];
+    // a thousandth of the (half) pixel width
+    const numeric eps = std::min(pixel_width_x, pixel_width_y) / numeric(1000);
+    periodicity_eps2 = eps * eps;
   }
 };
 };
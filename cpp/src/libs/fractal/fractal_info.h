@@ -13,9 +13,33 @@ struct fractal_info {
   bool smooth = false;
   bool do_grid = false;
   bool is_julia = false;
+  // report points inside the set early (cardioid/bulb test and periodicity checking)
+  bool interior = true;
+  // border tracing instead of splitting rectangles (works best without smoothing)
+  bool border_trace = false;
+  // store iterations in square tiles of this size (power of 2, 0 for plain rows)
+  size_t tile = 0;
+  // iterate pixels as double precision offsets from one arbitrary precision reference orbit
+  bool perturbation = false;
+  // render with the AVX double precision kernel when the polynomial allows it
+  bool simd = false;
+  // fused multiply-add in the simd kernel: faster, but rounds differently, so the values are no
+  // longer bit for bit the same as the other backends
+  bool fma = false;
+  // adaptive antialiasing: up to this many jittered samples for pixels that differ from a
+  // neighbor by more than aa_threshold (in log2 of the iterations), where the backend supports it
+  size_t aa_samples = 0;
+  double aa_threshold = 0.1;
+  // exterior distance estimates instead of iteration counts (crisp edges without subsampling),
+  // where the backend supports it. mul scales the distances before distance_transform
+  bool distance = false;
+  // terms of the series approximation used to skip iterations with perturbation (0 to disable)
+  size_t series_terms = 8;
   std::string color = "hot";
   std::string poly;
 };
 
 ADAPT_FIELDS(fractal_info, x, y, iter, r, i, cr, ci, zoom, mul, subsample, smooth, do_grid,
-             is_julia, color, poly, bits)
+             is_julia, color, poly, bits, perturbation,
+             series_terms, simd, interior, border_trace, tile, aa_samples, aa_threshold, distance,
+             fma)
@@ -0,0 +1,322 @@
+// (c) Copyright 2017 Josh Wright
+#include "fractal_perturbation.h"
+#include <boost/multiprecision/gmp.hpp>
+#include <cmath>
+#include <stdexcept>
+
+using namespace boost::multiprecision;
+
+namespace image_utils {
+
+// only used for the size of the view, which doesn't need much precision but may be very small
+typedef mpf_float_50 view_numeric;
+
+/** number of decimal digits needed to tell neighboring pixels apart at this zoom */
+static size_t digits_for_zoom(const std::string &zoom_str, size_t width) {
+  view_numeric zoom = numeric_from_string<view_numeric>(zoom_str) * width;
+  long exp2 = 0;
+  mpf_get_d_2exp(&exp2, zoom.backend().data());
+  if (exp2 <= 0) {
+    return 0;
+  }
+  return size_t(exp2 * std::log10(2.0)) + 1;
+}
+
+complex fractal_perturbation::index_to_delta(const vec_ull &pos) const {
+  // same mapping as fractal_impl::index_to_complex, without adding the center
+  return complex((pos[0] * 1.0 / iterations.x()) * (2 * half_width) - half_width,
+                 half_height - (pos[1] * 1.0 / iterations.y()) * (2 * half_height));
+}
+
+/**
+ * gmp number with its own precision. mpf_float takes its precision from a default shared by the
+ * whole process (including for temporaries), and frames at different zooms render at the same time
+ */
+struct orbit_number {
+  mpf_t v;
+
+  explicit orbit_number(const mp_bitcnt_t bits) { mpf_init2(v, bits); }
+  orbit_number(const orbit_number &) = delete;
+  orbit_number &operator=(const orbit_number &) = delete;
+  ~orbit_number() { mpf_clear(v); }
+
+  void set(const std::string &s) {
+    // gmp only takes a minus sign
+    const char *str = s.c_str() + (s.compare(0, 1, "+") == 0 ? 1 : 0);
+    if (mpf_set_str(v, str, 10) != 0) {
+      throw std::runtime_error("not a number: " + s);
+    }
+  }
+};
+
+void fractal_perturbation::compute_reference_orbit() {
+  // 20 extra digits so that the reference itself doesn't drift before max_iterations
+  const size_t digits = std::max(min_precision, digits_for_zoom(zoom, iterations.x()) + 20);
+  const mp_bitcnt_t bits = mp_bitcnt_t(std::ceil(digits * std::log2(10.0))) + 1;
+
+  orbit_number zr(bits), zi(bits), cr(bits), ci(bits), zr2(bits), zi2(bits), t(bits), cap(bits);
+  if (is_julia) {
+    zr.set(center_r);
+    zi.set(center_i);
+    mpf_set_d(cr.v, c.real());
+    mpf_set_d(ci.v, c.imag());
+  } else {
+    mpf_set_ui(zr.v, 0);
+    mpf_set_ui(zi.v, 0);
+    cr.set(center_r);
+    ci.set(center_i);
+  }
+  mpf_set_ui(cap.v, max_iterations);
+  mpf_mul(cap.v, cap.v, cap.v);
+  mpf_mul(zr2.v, zr.v, zr.v);
+  mpf_mul(zi2.v, zi.v, zi.v);
+
+  orbit.clear();
+  orbit.reserve(max_iterations + 1);
+  orbit.push_back(complex(mpf_get_d(zr.v), mpf_get_d(zi.v)));
+  for (size_t i = 0; i < max_iterations; i++) {
+    // zi = 2 zr zi + ci, zr = zr^2 - zi^2 + cr
+    mpf_mul(t.v, zr.v, zi.v);
+    mpf_mul_2exp(t.v, t.v, 1);
+    mpf_add(zi.v, t.v, ci.v);
+    mpf_sub(t.v, zr2.v, zi2.v);
+    mpf_add(zr.v, t.v, cr.v);
+    orbit.push_back(complex(mpf_get_d(zr.v), mpf_get_d(zi.v)));
+    mpf_mul(zr2.v, zr.v, zr.v);
+    mpf_mul(zi2.v, zi.v, zi.v);
+    mpf_add(t.v, zr2.v, zi2.v);
+    if (mpf_cmp(t.v, cap.v) > 0) {
+      break;
+    }
+  }
+  reference_length = orbit.size();
+}
+
+void fractal_perturbation::compute_series() {
+  skipped_iterations = 0;
+  series.clear();
+  if (series_terms == 0) {
+    return;
+  }
+  const double cap = double(max_iterations) * double(max_iterations);
+  const size_t last = orbit.size() - 1;
+
+  // probe a grid over the image reaching a little outside it, to cover subsampling too
+  const double px = half_width + 2 * pixel_width_x;
+  const double py = half_height + 2 * pixel_width_y;
+  const int grid = 2;
+  std::vector<complex> probes;
+  for (int i = -grid; i <= grid; i++) {
+    for (int j = -grid; j <= grid; j++) {
+      if (i != 0 || j != 0) {
+        probes.push_back(complex(px * i / grid, py * j / grid));
+      }
+    }
+  }
+  std::vector<complex> probe_dz(probes.size(), complex(0, 0));
+  if (is_julia) {
+    probe_dz = probes;
+  }
+  series_radius = std::abs(complex(px, py));
+
+  // coef[k] is the coefficient of (d/series_radius)^(k+1)
+  std::vector<complex> coef(series_terms, complex(0, 0));
+  std::vector<complex> next(series_terms);
+  if (is_julia) {
+    coef[0] = series_radius;
+  }
+  series = coef;
+
+  // always leave at least one step of the reference orbit to the pixels
+  for (size_t n = 0; n + 2 < last && n + 1 < max_iterations; n++) {
+    // squaring the series convolves the coefficients
+    const complex two_z = 2.0 * orbit[n];
+    for (size_t k = 0; k < series_terms; k++) {
+      complex sum = two_z * coef[k];
+      for (size_t j = 0; j < k; j++) {
+        sum += coef[j] * coef[k - 1 - j];
+      }
+      next[k] = sum;
+    }
+    if (!is_julia) {
+      next[0] += series_radius;
+    }
+    coef.swap(next);
+
+    // the series is only good as long as it agrees with the probes iterated the long way
+    for (size_t p = 0; p < probes.size(); p++) {
+      const complex dc = is_julia ? complex(0, 0) : probes[p];
+      probe_dz[p] = (2.0 * orbit[n] + probe_dz[p]) * probe_dz[p] + dc;
+      const complex z = orbit[n + 1] + probe_dz[p];
+      if (norm(z) > cap || norm(z) < norm(probe_dz[p])) {
+        // escaped, or would need a rebase
+        return;
+      }
+      complex approx(0, 0);
+      const complex u = probes[p] / series_radius;
+      for (size_t k = series_terms; k-- > 0;) {
+        approx = (approx + coef[k]) * u;
+      }
+      // written so that NaN fails too
+      if (!(std::abs(approx - probe_dz[p]) <= series_tolerance * std::abs(probe_dz[p]))) {
+        return;
+      }
+    }
+    series = coef;
+    skipped_iterations = n + 1;
+  }
+}
+
+complex fractal_perturbation::evaluate_series(const complex &delta) const {
+  const complex u = delta / series_radius;
+  complex out(0, 0);
+  for (size_t k = series.size(); k-- > 0;) {
+    out = (out + series[k]) * u;
+  }
+  return out;
+}
+
+double fractal_perturbation::iterate_delta(const complex &delta, size_t &n_rebases) const {
+  const double cap = double(max_iterations) * double(max_iterations);
+  // julia sets perturb the starting point, the mandelbrot set perturbs c
+  const complex dc = is_julia ? complex(0, 0) : delta;
+  complex dz = is_julia ? delta : complex(0, 0);
+  if (skipped_iterations > 0) {
+    dz = evaluate_series(delta);
+  }
+  const size_t last = orbit.size() - 1;
+  size_t m = skipped_iterations;
+  for (size_t i = skipped_iterations; i < max_iterations; i++) {
+    dz = (2.0 * orbit[m] + dz) * dz + dc;
+    m++;
+    const complex z = orbit[m] + dz;
+    const double r2 = norm(z);
+    if (r2 > cap) {
+      if (smooth) {
+        return i - log2(log2(r2 + 1) + 1) + 4.0;
+      } else {
+        return double(i);
+      }
+    }
+    if (r2 < norm(dz) || m == last) {
+      // rebase onto the start of the reference orbit
+      dz = z - orbit[0];
+      m = 0;
+      n_rebases++;
+    }
+  }
+  return double(0.0);
+}
+
+double fractal_perturbation::iterate_cell(const complex &delta, size_t &n_rebases) const {
+  if (subsample) {
+    double out[] = {
+        iterate_delta(delta + complex(-pixel_width_x, 0), n_rebases),
+        iterate_delta(delta + complex(pixel_width_x, 0), n_rebases),
+        iterate_delta(delta + complex(0, -pixel_width_y), n_rebases),
+        iterate_delta(delta + complex(0, pixel_width_y), n_rebases),
+    };
+    return ((out[0] + out[1]) + (out[2] + out[3])) / 4;
+  } else {
+    return iterate_delta(delta, n_rebases);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////
+
+void fractal_perturbation::run_singlethread() {
+  compute_reference_orbit();
+  compute_series();
+  rebases = 0;
+  for (size_t y = 0; y < iterations.y(); y++) {
+    for (size_t x = 0; x < iterations.x(); x++) {
+      iterations(x, y) = iterate_cell(index_to_delta(vec_ull{x, y}), rebases);
+    }
+  }
+  if (do_sine_transform) {
+    log_transform(iterations);
+    sine_transform(iterations, mul);
+  }
+}
+
+void fractal_perturbation::run_multithread() {
+  compute_reference_orbit();
+  compute_series();
+  size_t n_rebases = 0;
+#pragma omp parallel for schedule(dynamic, 1) reduction(+ : n_rebases)
+  for (size_t y = 0; y < iterations.y(); y++) {
+    for (size_t x = 0; x < iterations.x(); x++) {
+      iterations(x, y) = iterate_cell(index_to_delta(vec_ull{x, y}), n_rebases);
+    }
+  }
+  rebases = n_rebases;
+  if (do_sine_transform) {
+    log_transform(iterations);
+    sine_transform(iterations, mul);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////
+
+void fractal_perturbation::set_zoom(const std::string &r_str, const std::string &i_str,
+                                    const std::string &zoom_str) {
+  center_r = r_str;
+  center_i = i_str;
+  zoom = zoom_str;
+  // same as calc_bounds, but relative to the center
+  const size_t x = iterations.x();
+  const size_t y = iterations.y();
+  view_numeric dx = view_numeric(2) / numeric_from_string<view_numeric>(zoom_str);
+  view_numeric dy = dx;
+  if (x > y) {
+    /* widescreen image */
+    dx = view_numeric(1.0) * x / y * dy;
+  } else if (y > x) {
+    /* portrait */
+    dy = view_numeric(1.0) * y / x * dx;
+  }  // otherwise square
+  half_width = dx.convert_to<double>();
+  half_height = dy.convert_to<double>();
+  pixel_width_x = half_width / x;
+  pixel_width_y = half_height / y;
+}
+
+void fractal_perturbation::read_config(const fractal_info &cfg) {
+  fractal::read_config(cfg);
+  if (read_polynomial(cfg.poly) != STANDARD) {
+    throw std::runtime_error("perturbation only supports the standard polynomial");
+  }
+  if (cfg.distance) {
+    throw std::runtime_error("perturbation doesn't support distance estimates");
+  }
+  min_precision = cfg.bits;
+  series_terms = cfg.series_terms;
+  set_zoom(cfg.r, cfg.i, cfg.zoom);
+  c = complex(numeric_from_string<double>(cfg.cr), numeric_from_string<double>(cfg.ci));
+}
+
+fractal_perturbation::fractal_perturbation(const size_t w, const size_t h) : fractal(w, h) {}
+
+fractal_perturbation::fractal_perturbation(const fractal_perturbation &rhs)
+    : fractal(rhs),
+      c(rhs.c),
+      min_precision(rhs.min_precision),
+      series_terms(rhs.series_terms),
+      series_tolerance(rhs.series_tolerance),
+      center_r(rhs.center_r),
+      center_i(rhs.center_i),
+      zoom(rhs.zoom),
+      half_width(rhs.half_width),
+      half_height(rhs.half_height),
+      pixel_width_x(rhs.pixel_width_x),
+      pixel_width_y(rhs.pixel_width_y),
+      orbit(rhs.orbit),
+      series(rhs.series),
+      series_radius(rhs.series_radius) {}
+
+fractal_ref get_fractal_perturbation(const fractal_info &cfg) {
+  fractal_ref ref = std::make_shared<fractal_perturbation>(cfg.x, cfg.y);
+  ref->read_config(cfg);
+  return ref;
+}
+};
@@ -0,0 +1,90 @@
+// (c) Copyright 2017 Josh Wright
+#pragma once
+#include <vector>
+#include "fractal_common.h"
+#include "util/debug.h"
+
+namespace image_utils {
+
+fractal_ref get_fractal_perturbation(const fractal_info &cfg);
+
+/**
+ * deep zoom renderer for the standard polynomial. a single reference orbit is iterated at
+ * arbitrary precision at the center of the image, and every pixel only iterates its double
+ * precision offset from that orbit:
+ *
+ *     dz' = 2*Z*dz + dz^2 + dc
+ *
+ * glitches are avoided by rebasing: whenever the pixel's orbit gets closer to zero than its
+ * offset (or the reference orbit runs out) the offset is restarted from the beginning of the
+ * reference orbit.
+ *
+ * the offset at iteration n is also a power series in the pixel's offset d from the center (dc for
+ * the mandelbrot set, dz_0 for julia sets), and its coefficients only depend on the reference orbit:
+ *
+ *     dz_n = a_1*d + a_2*d^2 + ... + a_k*d^k
+ *
+ * before rendering, the coefficients are iterated until the series stops agreeing with probe
+ * points on the edges of the image. every pixel then starts from the series at that iteration
+ * instead of from zero, which skips most of the work for deep zooms with high iteration counts.
+ *
+ * pixel offsets are plain doubles, so this works until zoom ~1e300.
+ */
+class fractal_perturbation : public fractal {
+ public:
+  complex c = complex(0.0, 0.0);
+  /* minimum number of decimal digits for the reference orbit, more are used if the zoom needs it */
+  size_t min_precision = 64;
+  /* number of terms in the series approximation, 0 to disable it */
+  size_t series_terms = 8;
+  /* relative error allowed between the series and the probe points */
+  double series_tolerance = 1e-12;
+
+  /* statistics from the last run */
+  size_t reference_length = 0;
+  size_t rebases = 0;
+  size_t skipped_iterations = 0;
+
+ protected:
+  /* strings to keep full precision until the reference orbit is computed */
+  std::string center_r = "0", center_i = "0", zoom = "1";
+  /* half width and height of the image, relative to the center */
+  double half_width = 2, half_height = 2;
+  double pixel_width_x, pixel_width_y;
+  std::vector<complex> orbit;
+  /* coefficients are scaled by powers of series_radius to keep them representable as doubles */
+  std::vector<complex> series;
+  double series_radius = 1;
+
+ public:
+  /** offset of a pixel from the center of the image */
+  complex index_to_delta(const vec_ull &pos) const;
+
+  void compute_reference_orbit();
+
+  /** find how many iterations can be skipped and the series coefficients at that iteration */
+  void compute_series();
+
+  complex evaluate_series(const complex &delta) const;
+
+  double iterate_delta(const complex &delta, size_t &n_rebases) const;
+
+  double iterate_cell(const complex &delta, size_t &n_rebases) const;
+
+  /////////////////////////////////////////////////////////////////////////////
+
+  virtual void run_singlethread();
+  virtual void run_multithread();
+
+  /////////////////////////////////////////////////////////////////////////////
+
+  fractal_perturbation(const size_t w, const size_t h);
+
+  fractal_perturbation(const fractal_perturbation &rhs);
+
+  virtual void read_config(const fractal_info &cfg);
+
+  virtual void set_zoom(const std::string &r_str, const std::string &i_str,
+                        const std::string &zoom_str);
+};
+};
@@ -0,0 +1,44 @@
+// (c) Copyright 2017 Josh Wright
+#include "fractal_simd.h"
+#include <stdexcept>
+
+namespace image_utils {
+
+simd_isa detect_simd_isa() {
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f")) {
+    return ISA_AVX512;
+  }
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+    return ISA_AVX2;
+  }
+  if (__builtin_cpu_supports("avx")) {
+    return ISA_AVX;
+  }
+  // part of x86-64
+  return ISA_SSE2;
+}
+
+const char *simd_isa_name(simd_isa isa) {
+  switch (isa) {
+    case ISA_SSE2:
+      return "sse2";
+    case ISA_AVX:
+      return "avx";
+    case ISA_AVX2:
+      return "avx2";
+    case ISA_AVX512:
+      return "avx512";
+  }
+  throw std::runtime_error("unknown instruction set");
+}
+
+const simd_kernels &get_simd_kernels(simd_isa isa) {
+  static const simd_kernels kernels[] = {
+      simd_kernels_sse2(), simd_kernels_avx(), simd_kernels_avx2(), simd_kernels_avx512(),
+  };
+  return kernels[isa];
+}
+
+double simd_exact_norm(double re, double im) { return re * re + im * im; }
+};
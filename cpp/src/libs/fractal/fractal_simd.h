@@ -0,0 +1,68 @@
+// (c) Copyright 2017 Josh Wright
+#pragma once
+#include <cstddef>
+
+/*
+ * the vector fractal kernels are compiled once per instruction set (fractal_simd_*.cpp, each with
+ * its own compiler flags) and the best one the cpu supports is picked at runtime.
+ *
+ * nothing in this header may pull in inline functions or templates: the kernel files are built
+ * with -mavx2 etc, and the linker is free to keep their copy of any inline function for the whole
+ * program, which would then crash on older cpus.
+ */
+
+namespace image_utils {
+
+enum simd_isa {
+  ISA_SSE2,
+  ISA_AVX,
+  ISA_AVX2,
+  ISA_AVX512,
+};
+
+/** best instruction set supported by this cpu (and os) */
+simd_isa detect_simd_isa();
+
+const char *simd_isa_name(simd_isa isa);
+
+/** everything the kernels need to know about the image, as plain data */
+struct simd_view {
+  /* same as the bounds of fractal_impl: xmin, xmax, ymin, ymax */
+  double bounds[4];
+  size_t width, height;
+  double pixel_width_x, pixel_width_y;
+  /* julia constant */
+  double cr, ci;
+  size_t max_iterations;
+  bool is_julia;
+  bool smooth;
+  bool subsample;
+  bool cubic;
+  bool fused;
+  /* cardioid/bulb test and periodicity checking, see fractal_impl::fractal_cell_ */
+  bool check_interior;
+  double periodicity_eps2;
+  /* split the rows between omp threads */
+  bool parallel;
+};
+
+struct simd_kernels {
+  /** exact escape time (same as fractal_impl) in double precision, row major output */
+  void (*render_f64)(const simd_view &view, double *out);
+  /** fast preview in single precision, raw iteration counts, row major output */
+  void (*render_f32)(const simd_view &view, double *out);
+};
+
+const simd_kernels &get_simd_kernels(simd_isa isa);
+
+/**
+ * re*re + im*im like fractal_impl, to confirm what the fused kernels find with their own norms.
+ * defined in fractal_simd.cpp, which isn't built with -mfma
+ */
+double simd_exact_norm(double re, double im);
+
+simd_kernels simd_kernels_sse2();
+simd_kernels simd_kernels_avx();
+simd_kernels simd_kernels_avx2();
+simd_kernels simd_kernels_avx512();
+};
@@ -0,0 +1,49 @@
+// (c) Copyright 2017 Josh Wright
+/*
+ * 256 bit traits for fractal_simd_kernels.inl, shared by the avx and avx2 builds. the only
+ * difference between them is that fused multiply-add is real with -mfma
+ */
+#include <cstddef>
+#include <immintrin.h>
+
+namespace image_utils {
+namespace {
+
+struct f64_traits {
+  typedef __m256d reg;
+  enum { lanes = 4 };
+  static reg set1(double a) { return _mm256_set1_pd(a); }
+  static reg loadu(const double *p) { return _mm256_loadu_pd(p); }
+  static void storeu(double *p, reg a) { _mm256_storeu_pd(p, a); }
+  static reg add(reg a, reg b) { return _mm256_add_pd(a, b); }
+  static reg sub(reg a, reg b) { return _mm256_sub_pd(a, b); }
+  static reg mul(reg a, reg b) { return _mm256_mul_pd(a, b); }
+#ifdef __FMA__
+  static reg fmadd(reg a, reg b, reg c) { return _mm256_fmadd_pd(a, b, c); }
+  static reg fmsub(reg a, reg b, reg c) { return _mm256_fmsub_pd(a, b, c); }
+#else
+  static reg fmadd(reg a, reg b, reg c) { return _mm256_add_pd(_mm256_mul_pd(a, b), c); }
+  static reg fmsub(reg a, reg b, reg c) { return _mm256_sub_pd(_mm256_mul_pd(a, b), c); }
+#endif
+  static int cmpgt(reg a, reg b) { return _mm256_movemask_pd(_mm256_cmp_pd(a, b, _CMP_GT_OQ)); }
+  static int cmplt(reg a, reg b) { return _mm256_movemask_pd(_mm256_cmp_pd(a, b, _CMP_LT_OQ)); }
+};
+
+struct f32_traits {
+  typedef __m256 reg;
+  enum { lanes = 8 };
+  static reg set1(float a) { return _mm256_set1_ps(a); }
+  static reg loadu(const float *p) { return _mm256_loadu_ps(p); }
+  static void storeu(float *p, reg a) { _mm256_storeu_ps(p, a); }
+  static reg add(reg a, reg b) { return _mm256_add_ps(a, b); }
+  static reg sub(reg a, reg b) { return _mm256_sub_ps(a, b); }
+  static reg mul(reg a, reg b) { return _mm256_mul_ps(a, b); }
+  static int cmplt(reg a, reg b) { return _mm256_movemask_ps(_mm256_cmp_ps(a, b, _CMP_LT_OS)); }
+  static reg add_if_lt(reg acc, reg a, reg b, reg v) {
+    return _mm256_add_ps(_mm256_and_ps(_mm256_cmp_ps(a, b, _CMP_LT_OS), v), acc);
+  }
+};
+};
+};
+
+#include "fractal_simd_kernels.inl"
@@ -0,0 +1,6 @@
+// (c) Copyright 2017 Josh Wright
+#include "fractal_simd_256.inl"
+
+namespace image_utils {
+simd_kernels simd_kernels_avx() { return make_simd_kernels<f64_traits, f32_traits>(); }
+};
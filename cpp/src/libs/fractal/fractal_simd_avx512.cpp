@@ -0,0 +1,44 @@
+// (c) Copyright 2017 Josh Wright
+#include <cstddef>
+#include <immintrin.h>
+
+namespace image_utils {
+namespace {
+
+struct f64_traits {
+  typedef __m512d reg;
+  enum { lanes = 8 };
+  static reg set1(double a) { return _mm512_set1_pd(a); }
+  static reg loadu(const double *p) { return _mm512_loadu_pd(p); }
+  static void storeu(double *p, reg a) { _mm512_storeu_pd(p, a); }
+  static reg add(reg a, reg b) { return _mm512_add_pd(a, b); }
+  static reg sub(reg a, reg b) { return _mm512_sub_pd(a, b); }
+  static reg mul(reg a, reg b) { return _mm512_mul_pd(a, b); }
+  static reg fmadd(reg a, reg b, reg c) { return _mm512_fmadd_pd(a, b, c); }
+  static reg fmsub(reg a, reg b, reg c) { return _mm512_fmsub_pd(a, b, c); }
+  static int cmpgt(reg a, reg b) { return _mm512_cmp_pd_mask(a, b, _CMP_GT_OQ); }
+  static int cmplt(reg a, reg b) { return _mm512_cmp_pd_mask(a, b, _CMP_LT_OQ); }
+};
+
+struct f32_traits {
+  typedef __m512 reg;
+  enum { lanes = 16 };
+  static reg set1(float a) { return _mm512_set1_ps(a); }
+  static reg loadu(const float *p) { return _mm512_loadu_ps(p); }
+  static void storeu(float *p, reg a) { _mm512_storeu_ps(p, a); }
+  static reg add(reg a, reg b) { return _mm512_add_ps(a, b); }
+  static reg sub(reg a, reg b) { return _mm512_sub_ps(a, b); }
+  static reg mul(reg a, reg b) { return _mm512_mul_ps(a, b); }
+  static int cmplt(reg a, reg b) { return _mm512_cmp_ps_mask(a, b, _CMP_LT_OS); }
+  static reg add_if_lt(reg acc, reg a, reg b, reg v) {
+    return _mm512_mask_add_ps(acc, _mm512_cmp_ps_mask(a, b, _CMP_LT_OS), acc, v);
+  }
+};
+};
+};
+
+#include "fractal_simd_kernels.inl"
+
+namespace image_utils {
+simd_kernels simd_kernels_avx512() { return make_simd_kernels<f64_traits, f32_traits>(); }
+};
@@ -0,0 +1,402 @@
+// (c) Copyright 2017 Josh Wright
+/*
+ * vector fractal kernels, written once against a small traits struct per register type:
+ *
+ *     reg, lanes, set1, loadu, storeu, add, sub, mul, fmadd, fmsub, cmpgt, cmplt (lane bitmasks)
+ *
+ * and for the single precision preview also add_if_lt.
+ *
+ * included by each fractal_simd_<isa>.cpp after defining f64_traits and f32_traits. everything
+ * here is in an anonymous namespace, and only plain data crosses into the rest of the program
+ * (see fractal_simd.h)
+ */
+#include <cmath>
+#include <cstddef>
+#include "fractal_simd.h"
+
+namespace image_utils {
+namespace {
+
+/** z*z + c, or z*z*z + c. same order of operations as std::complex unless fused */
+template <class V, bool cubic, bool fused>
+inline void simd_f64_step(typename V::reg &zr, typename V::reg &zi, const typename V::reg cr,
+                          const typename V::reg ci) {
+  typename V::reg tr, ti;
+  if (fused) {
+    tr = V::fmsub(zr, zr, V::mul(zi, zi));
+    ti = V::fmadd(zr, zi, V::mul(zi, zr));
+  } else {
+    tr = V::sub(V::mul(zr, zr), V::mul(zi, zi));
+    ti = V::add(V::mul(zr, zi), V::mul(zi, zr));
+  }
+  if (cubic) {
+    typename V::reg sr, si;
+    if (fused) {
+      sr = V::fmsub(tr, zr, V::mul(ti, zi));
+      si = V::fmadd(tr, zi, V::mul(ti, zr));
+    } else {
+      sr = V::sub(V::mul(tr, zr), V::mul(ti, zi));
+      si = V::add(V::mul(tr, zi), V::mul(ti, zr));
+    }
+    tr = sr;
+    ti = si;
+  }
+  zr = V::add(tr, cr);
+  zi = V::add(ti, ci);
+}
+
+/*
+ * the image is split into blocks of pixels for the threads. with subsampling every pixel is 4
+ * consecutive samples
+ */
+const size_t simd_block_pixels = 256;
+
+/** same as in_cardioid_or_bulb in fractal_common.h */
+inline bool simd_in_cardioid_or_bulb(const double x, const double y) {
+  const double y2 = y * y;
+  const double xq = x - double(0.25);
+  const double q = xq * xq + y2;
+  if (q * (q + xq) <= double(0.25) * y2) {
+    return true;
+  }
+  const double x1 = x + double(1);
+  return x1 * x1 + y2 <= double(0.0625);
+}
+
+/**
+ * same as fractal_impl::fractal_cell for every sample of a block, including the checks for points
+ * inside the set.
+ *
+ * each lane works on its own sample, and as soon as one escapes (or runs out of iterations) the
+ * lane is refilled with the next sample of the block. so lanes never sit idle waiting for the
+ * slowest sample of a vector, only at the very end of the block.
+ *
+ * without fma the vector norms are the same zr*zr + zi*zi that fractal_impl compares (the build
+ * never contracts on its own), so the lanes they flag are final. the fused kernels compute the
+ * escape norm with fma, which can round differently, so there it only finds lanes that are close
+ * to escaping, and that is confirmed with simd_exact_norm. the distance to the saved point is
+ * never fused.
+ */
+template <class V, bool cubic, bool fused>
+void simd_f64_render(const simd_view &view, double *out) {
+  typedef typename V::reg reg;
+  const size_t width = view.width;
+  const size_t n_pixels = view.width * view.height;
+  const size_t samples_per_pixel = view.subsample ? 4 : 1;
+  const size_t n_blocks = (n_pixels + simd_block_pixels - 1) / simd_block_pixels;
+  const size_t max_iterations = view.max_iterations;
+  const double cap = double(max_iterations) * double(max_iterations);
+  // the fused norm is only close to the exact one
+  const reg near_cap = V::set1(fused ? cap * (1 - 1e-9) : cap);
+  const bool periodicity = view.check_interior;
+  const reg eps2 = V::set1(view.periodicity_eps2);
+  const bool cardioid = view.check_interior && !view.is_julia && !cubic;
+  const double *b = view.bounds;
+  const double offset_r[] = {-view.pixel_width_x, view.pixel_width_x, 0, 0};
+  const double offset_i[] = {0, 0, -view.pixel_width_y, view.pixel_width_y};
+
+#pragma omp parallel for schedule(dynamic, 1) if (view.parallel)
+  for (size_t block = 0; block < n_blocks; block++) {
+    const size_t first = block * simd_block_pixels;
+    const size_t count =
+        n_pixels - first < simd_block_pixels ? n_pixels - first : simd_block_pixels;
+    const size_t n_samples = count * samples_per_pixel;
+    double samples[4 * simd_block_pixels];
+
+    /* state of each lane. the vectors are only spilled here when a lane needs attention */
+    size_t sample[V::lanes], start[V::lanes];
+    double zr_a[V::lanes], zi_a[V::lanes], cr_a[V::lanes], ci_a[V::lanes];
+    /* brent's algorithm: saved point, and when it moves next */
+    double sr_a[V::lanes], si_a[V::lanes];
+    size_t period[V::lanes], refresh[V::lanes];
+    size_t next = 0;
+    size_t step = 0;
+    int live = 0;
+
+    /* next sample that actually needs iterating into lane k, false when there are none left */
+    auto load_lane = [&](const int k) {
+      while (next < n_samples) {
+        const size_t t = next++;
+        if (max_iterations == 0) {
+          // fractal_cell doesn't iterate at all, and a lane only retires after its last iteration
+          samples[t] = 0.0;
+          continue;
+        }
+        const size_t p = first + t / samples_per_pixel;
+        // same as fractal_impl::index_to_complex
+        double re = ((p % width) * 1.0 / width) * (b[1] - b[0]) + b[0];
+        double im = b[3] - ((p / width) * 1.0 / view.height) * (b[3] - b[2]);
+        if (view.subsample) {
+          re = re + offset_r[t % 4];
+          im = im + offset_i[t % 4];
+        }
+        if (cardioid && simd_in_cardioid_or_bulb(re, im)) {
+          samples[t] = 0.0;
+          continue;
+        }
+        if (view.is_julia) {
+          zr_a[k] = re;
+          zi_a[k] = im;
+          cr_a[k] = view.cr;
+          ci_a[k] = view.ci;
+        } else {
+          zr_a[k] = 0;
+          zi_a[k] = 0;
+          cr_a[k] = re;
+          ci_a[k] = im;
+        }
+        sr_a[k] = zr_a[k];
+        si_a[k] = zi_a[k];
+        period[k] = 1;
+        refresh[k] = step + 1;
+        sample[k] = t;
+        start[k] = step;
+        live |= 1 << k;
+        return true;
+      }
+      return false;
+    };
+
+    for (int k = 0; k < V::lanes; k++) {
+      if (!load_lane(k)) {
+        // never read, but keeps the idle lanes from computing on garbage
+        zr_a[k] = zi_a[k] = cr_a[k] = ci_a[k] = sr_a[k] = si_a[k] = 0;
+        start[k] = 0;
+      }
+    }
+    reg zr = V::loadu(zr_a);
+    reg zi = V::loadu(zi_a);
+    reg cr = V::loadu(cr_a);
+    reg ci = V::loadu(ci_a);
+    reg sr = V::loadu(sr_a);
+    reg si = V::loadu(si_a);
+    /* next step at which some lane runs out of iterations or moves its saved point */
+    size_t next_event = 1;
+
+    while (live) {
+      simd_f64_step<V, cubic, fused>(zr, zi, cr, ci);
+      step++;
+      reg norm;
+      if (fused) {
+        norm = V::fmadd(zr, zr, V::mul(zi, zi));
+      } else {
+        norm = V::add(V::mul(zr, zr), V::mul(zi, zi));
+      }
+      const int maybe_escaped = V::cmpgt(norm, near_cap) & live;
+      int cycle = 0;
+      if (periodicity) {
+        const reg dr = V::sub(zr, sr);
+        const reg di = V::sub(zi, si);
+        cycle = V::cmplt(V::add(V::mul(dr, dr), V::mul(di, di)), eps2) & live;
+      }
+      if (!maybe_escaped && !cycle && step != next_event) {
+        continue;
+      }
+
+      V::storeu(zr_a, zr);
+      V::storeu(zi_a, zi);
+      bool refilled = false;
+      for (int k = 0; k < V::lanes; k++) {
+        if (!(live & (1 << k))) {
+          continue;
+        }
+        // the loop index of fractal_cell for this lane
+        const size_t i = step - 1 - start[k];
+        bool done = (cycle & (1 << k)) != 0;
+        double result = 0.0;
+        if (!done && (maybe_escaped & (1 << k))) {
+          // for the smooth value, and to confirm the fused norm
+          const double n = fused ? simd_exact_norm(zr_a[k], zi_a[k])
+                                 : zr_a[k] * zr_a[k] + zi_a[k] * zi_a[k];
+          if (n > cap) {
+            done = true;
+            result = view.smooth ? i - log2(log2(n + 1) + 1) + 4.0 : double(i);
+          }
+        }
+        if (!done && i + 1 == max_iterations) {
+          done = true;
+        }
+        if (done) {
+          samples[sample[k]] = result;
+          live &= ~(1 << k);
+          refilled = load_lane(k) || refilled;
+        } else if (periodicity && step == refresh[k]) {
+          sr_a[k] = zr_a[k];
+          si_a[k] = zi_a[k];
+          period[k] *= 2;
+          refresh[k] = step + period[k];
+        }
+      }
+      zr = V::loadu(zr_a);
+      zi = V::loadu(zi_a);
+      if (refilled) {
+        cr = V::loadu(cr_a);
+        ci = V::loadu(ci_a);
+      }
+      if (periodicity) {
+        sr = V::loadu(sr_a);
+        si = V::loadu(si_a);
+      }
+      next_event = step + max_iterations;
+      for (int k = 0; k < V::lanes; k++) {
+        if (live & (1 << k)) {
+          if (start[k] + max_iterations < next_event) {
+            next_event = start[k] + max_iterations;
+          }
+          if (periodicity && refresh[k] < next_event) {
+            next_event = refresh[k];
+          }
+        }
+      }
+    }
+
+    for (size_t i = 0; i < count; i++) {
+      if (view.subsample) {
+        const double *q = samples + 4 * i;
+        out[first + i] = ((q[0] + q[1]) + (q[2] + q[3])) / 4;
+      } else {
+        out[first + i] = samples[i];
+      }
+    }
+  }
+}
+
+template <class V>
+void simd_f64_render_any(const simd_view &view, double *out) {
+  if (view.cubic) {
+    if (view.fused) {
+      simd_f64_render<V, true, true>(view, out);
+    } else {
+      simd_f64_render<V, true, false>(view, out);
+    }
+  } else {
+    if (view.fused) {
+      simd_f64_render<V, false, true>(view, out);
+    } else {
+      simd_f64_render<V, false, false>(view, out);
+    }
+  }
+}
+
+/**
+ * quick preview of the standard mandelbrot set in single precision.
+ *
+ * pixels are numbered across rows and handed out in blocks. like simd_f64_render, a lane that
+ * escapes is refilled with the next pixel of the block right away, so the end of a row and the
+ * start of the next share vectors and only the end of a block has idle lanes
+ */
+template <class V>
+void simd_f32_render(const simd_view &view, double *out) {
+  typedef typename V::reg reg;
+  const size_t width = view.width;
+  const size_t n_pixels = view.width * view.height;
+  const size_t n_blocks = (n_pixels + simd_block_pixels - 1) / simd_block_pixels;
+  const double *b = view.bounds;
+  const float xmin = b[0];
+  const float ymin = b[2];
+  const float xscale = (b[1] - b[0]) / width;
+  const float yscale = (b[3] - b[2]) / view.height;
+  const reg threshold = V::set1(view.max_iterations * view.max_iterations);
+  const reg one = V::set1(1);
+  if (view.max_iterations <= 2) {
+    // the first count is free
+    for (size_t p = 0; p < n_pixels; p++) {
+      out[p] = 1;
+    }
+    return;
+  }
+  /* the count starts at 1, and every pixel gets max_iterations - 2 steps */
+  const reg steps_limit = V::set1(view.max_iterations - 2);
+
+#pragma omp parallel for schedule(dynamic, 1) if (view.parallel)
+  for (size_t block = 0; block < n_blocks; block++) {
+    const size_t first = block * simd_block_pixels;
+    const size_t end = n_pixels - first < simd_block_pixels ? n_pixels : first + simd_block_pixels;
+
+    size_t pixel[V::lanes];
+    float zr_a[V::lanes], zi_a[V::lanes], cr_a[V::lanes], ci_a[V::lanes];
+    float mk_a[V::lanes], steps_a[V::lanes];
+    size_t next = first;
+    int live = 0;
+
+    auto load_lane = [&](const int k) {
+      while (next < end) {
+        const size_t p = next++;
+        cr_a[k] = float(p % width) * xscale + xmin;
+        ci_a[k] = float(p / width) * yscale + ymin;
+        if (view.check_interior && simd_in_cardioid_or_bulb(cr_a[k], ci_a[k])) {
+          // what the loop would have counted
+          out[p] = view.max_iterations - 1;
+          continue;
+        }
+        zr_a[k] = cr_a[k];
+        zi_a[k] = ci_a[k];
+        mk_a[k] = 1;
+        steps_a[k] = 0;
+        pixel[k] = p;
+        live |= 1 << k;
+        return true;
+      }
+      return false;
+    };
+
+    for (int k = 0; k < V::lanes; k++) {
+      if (!load_lane(k)) {
+        zr_a[k] = zi_a[k] = cr_a[k] = ci_a[k] = mk_a[k] = steps_a[k] = 0;
+      }
+    }
+    reg zr = V::loadu(zr_a), zi = V::loadu(zi_a);
+    reg cr = V::loadu(cr_a), ci = V::loadu(ci_a);
+    reg mk = V::loadu(mk_a), steps = V::loadu(steps_a);
+
+    while (live) {
+      /* zr1 = zr0 * zr0 - zi0 * zi0 + cr */
+      /* zi1 = zr0 * zi0 + zr0 * zi0 + ci */
+      reg zr2 = V::mul(zr, zr);
+      reg zi2 = V::mul(zi, zi);
+      reg zrzi = V::mul(zr, zi);
+      zr = V::add(V::sub(zr2, zi2), cr);
+      zi = V::add(V::add(zrzi, zrzi), ci);
+      steps = V::add(steps, one);
+
+      /* count the lanes that are still inside */
+      zr2 = V::mul(zr, zr);
+      zi2 = V::mul(zi, zi);
+      const reg mag2 = V::add(zr2, zi2);
+      mk = V::add_if_lt(mk, mag2, threshold, one);
+
+      const int running = V::cmplt(mag2, threshold) & V::cmplt(steps, steps_limit);
+      const int finished = live & ~running;
+      if (!finished) {
+        continue;
+      }
+
+      V::storeu(zr_a, zr);
+      V::storeu(zi_a, zi);
+      V::storeu(cr_a, cr);
+      V::storeu(ci_a, ci);
+      V::storeu(mk_a, mk);
+      V::storeu(steps_a, steps);
+      for (int k = 0; k < V::lanes; k++) {
+        if (finished & (1 << k)) {
+          out[pixel[k]] = mk_a[k];
+          live &= ~(1 << k);
+          load_lane(k);
+        }
+      }
+      zr = V::loadu(zr_a), zi = V::loadu(zi_a);
+      cr = V::loadu(cr_a), ci = V::loadu(ci_a);
+      mk = V::loadu(mk_a), steps = V::loadu(steps_a);
+    }
+  }
+}
+
+template <class D, class F>
+simd_kernels make_simd_kernels() {
+  simd_kernels kernels;
+  kernels.render_f64 = simd_f64_render_any<D>;
+  kernels.render_f32 = simd_f32_render<F>;
+  return kernels;
+}
+};
+};
@@ -0,0 +1,45 @@
+// (c) Copyright 2017 Josh Wright
+#include <cstddef>
+#include <emmintrin.h>
+
+namespace image_utils {
+namespace {
+
+struct f64_traits {
+  typedef __m128d reg;
+  enum { lanes = 2 };
+  static reg set1(double a) { return _mm_set1_pd(a); }
+  static reg loadu(const double *p) { return _mm_loadu_pd(p); }
+  static void storeu(double *p, reg a) { _mm_storeu_pd(p, a); }
+  static reg add(reg a, reg b) { return _mm_add_pd(a, b); }
+  static reg sub(reg a, reg b) { return _mm_sub_pd(a, b); }
+  static reg mul(reg a, reg b) { return _mm_mul_pd(a, b); }
+  /* no fma before haswell */
+  static reg fmadd(reg a, reg b, reg c) { return _mm_add_pd(_mm_mul_pd(a, b), c); }
+  static reg fmsub(reg a, reg b, reg c) { return _mm_sub_pd(_mm_mul_pd(a, b), c); }
+  static int cmpgt(reg a, reg b) { return _mm_movemask_pd(_mm_cmpgt_pd(a, b)); }
+  static int cmplt(reg a, reg b) { return _mm_movemask_pd(_mm_cmplt_pd(a, b)); }
+};
+
+struct f32_traits {
+  typedef __m128 reg;
+  enum { lanes = 4 };
+  static reg set1(float a) { return _mm_set1_ps(a); }
+  static reg loadu(const float *p) { return _mm_loadu_ps(p); }
+  static void storeu(float *p, reg a) { _mm_storeu_ps(p, a); }
+  static reg add(reg a, reg b) { return _mm_add_ps(a, b); }
+  static reg sub(reg a, reg b) { return _mm_sub_ps(a, b); }
+  static reg mul(reg a, reg b) { return _mm_mul_ps(a, b); }
+  static int cmplt(reg a, reg b) { return _mm_movemask_ps(_mm_cmplt_ps(a, b)); }
+  static reg add_if_lt(reg acc, reg a, reg b, reg v) {
+    return _mm_add_ps(_mm_and_ps(_mm_cmplt_ps(a, b), v), acc);
+  }
+};
+};
+};
+
+#include "fractal_simd_kernels.inl"
+
+namespace image_utils {
+simd_kernels simd_kernels_sse2() { return make_simd_kernels<f64_traits, f32_traits>(); }
+};
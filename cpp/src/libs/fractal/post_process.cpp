@@ -0,0 +1,105 @@
+// (c) Copyright 2017 Josh Wright
+#include "post_process.h"
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+namespace image_utils {
+
+/** same arithmetic as log_transform and sine_transform (or distance_transform) */
+static inline double transform(double x, const post_process_settings &s) {
+  if (s.distance) {
+    return 1 - exp(-x * s.distance_mul);
+  }
+  if (s.log) {
+    x = log2((x + 1) * s.log_mul);
+  }
+  if (s.sine && (!s.preserve_zero || x != 0)) {
+    x = sin(x * PI / 4 * s.sine_mul + 2 * PI * s.rel_phase);
+    x *= x;
+  }
+  return x;
+}
+
+/**
+ * color(const double *values, size_t n, RGB *out) colors one contiguous segment of normalized
+ * values. segments are at most one row, or one row of a tile
+ */
+template <typename T, typename F>
+static post_process_stats post_process_(const matrix<T> &in, const tile_layout &layout,
+                                        const post_process_settings &settings, image_RGB &out,
+                                        const F &color) {
+  if (in.x() != out.x() || in.y() != out.y()) {
+    throw std::runtime_error("Image dimensions must be the same!");
+  }
+  const T *data = in.data();
+  const size_t n = in.size();
+
+  double min = INF, max = -INF;
+#pragma omp parallel for schedule(static) reduction(min : min) reduction(max : max)
+  for (size_t i = 0; i < n; i++) {
+    const double x = transform(data[i], settings);
+    min = std::min(min, x);
+    max = std::max(max, x);
+  }
+
+  const size_t w = in.x();
+  // each row of a tile is contiguous
+  const size_t step = layout.linear() ? w : layout.tile;
+  const double range = max - min;
+#pragma omp parallel
+  {
+    std::vector<double> values(step);
+#pragma omp for schedule(static)
+    for (size_t y = 0; y < in.y(); y++) {
+      for (size_t x0 = 0; x0 < w; x0 += step) {
+        const T *d = data + layout.index(x0, y);
+        const size_t len = std::min(step, w - x0);
+        for (size_t i = 0; i < len; i++) {
+          double x = transform(d[i], settings);
+          if (settings.normalize) {
+            // same as scale_grid
+            x -= min;
+            x /= range;
+          }
+          values[i] = x;
+        }
+        color(values.data(), len, out.data() + y * w + x0);
+      }
+    }
+  }
+  return post_process_stats{min, max};
+}
+
+template <typename T>
+post_process_stats post_process(const matrix<T> &in, const tile_layout &layout,
+                                const post_process_settings &settings, const colormap_func &cmap,
+                                image_RGB &out) {
+  return post_process_(in, layout, settings, out, [&](const double *v, size_t n, RGB *px) {
+    for (size_t i = 0; i < n; i++) {
+      px[i] = cmap(v[i]);
+    }
+  });
+}
+
+template <typename T>
+post_process_stats post_process(const matrix<T> &in, const tile_layout &layout,
+                                const post_process_settings &settings, const colormap_lut &lut,
+                                image_RGB &out) {
+  return post_process_(in, layout, settings, out,
+                       [&](const double *v, size_t n, RGB *px) { lut.map(v, n, px); });
+}
+
+template post_process_stats post_process<float>(const matrix<float> &, const tile_layout &,
+                                                const post_process_settings &,
+                                                const colormap_func &, image_RGB &);
+template post_process_stats post_process<double>(const matrix<double> &, const tile_layout &,
+                                                 const post_process_settings &,
+                                                 const colormap_func &, image_RGB &);
+template post_process_stats post_process<float>(const matrix<float> &, const tile_layout &,
+                                                const post_process_settings &,
+                                                const colormap_lut &, image_RGB &);
+template post_process_stats post_process<double>(const matrix<double> &, const tile_layout &,
+                                                 const post_process_settings &,
+                                                 const colormap_lut &, image_RGB &);
+};
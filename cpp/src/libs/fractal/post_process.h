@@ -0,0 +1,48 @@
+// (c) Copyright 2017 Josh Wright
+#pragma once
+
+#include "colormaps.h"
+#include "types.h"
+
+namespace image_utils {
+
+/**
+ * log_transform -> sine_transform -> scale_grid -> grayscale_to_rgb, in two passes over the
+ * iterations instead of one or two each: the first only finds the range of the transformed values,
+ * the second transforms again, normalizes and colors. the iterations themselves are not modified.
+ *
+ * gives the same colors as calling the separate functions in that order
+ */
+struct post_process_settings {
+  bool log = true;
+  /* multiplier of log_transform */
+  double log_mul = 1;
+  bool sine = true;
+  /* arguments of sine_transform */
+  double sine_mul = 1;
+  double rel_phase = 0;
+  bool preserve_zero = true;
+  /* distance_transform instead of the other two, for distance estimates */
+  bool distance = false;
+  double distance_mul = 1;
+  /* scale to [0, 1] like scale_grid */
+  bool normalize = true;
+};
+
+/** range of the transformed values, before normalizing */
+struct post_process_stats {
+  double min, max;
+};
+
+/** in is stored with layout, out is always plain rows. defined for float and double */
+template <typename T>
+post_process_stats post_process(const matrix<T> &in, const tile_layout &layout,
+                                const post_process_settings &settings, const colormap_func &cmap,
+                                image_RGB &out);
+
+/** same, with the colors rounded to the steps of the lookup table */
+template <typename T>
+post_process_stats post_process(const matrix<T> &in, const tile_layout &layout,
+                                const post_process_settings &settings, const colormap_lut &lut,
+                                image_RGB &out);
+};
@@ -1,20 +1,407 @@
 // (c) Copyright 2016 Josh Wright
 #include "io.h"
+#include <algorithm>
 #include <cmath>
+#include <cstdlib>
 #include <cstring>
 #include <iostream>
 #include <set>
+#include <sstream>
+#include <stdexcept>
 #include <string>
 #include <unordered_map>
+#include <zlib.h>
 #include "lodepng.h"
 
 namespace image_utils {
 
+png_settings png_settings::fast() {
+  png_settings s;
+  s.level = 1;
+  s.filter = PNG_FILTER_ZERO;
+  return s;
+}
+
+png_settings png_settings::store() {
+  png_settings s;
+  s.level = 0;
+  s.filter = PNG_FILTER_ZERO;
+  return s;
+}
+
+/**
+ * raw deflate of in[begin, end) in chunks of chunk_size, in parallel. every chunk ends on a byte
+ * boundary (Z_SYNC_FLUSH) and is primed with the 32k before it as its dictionary, so the compression
+ * barely suffers and the chunks can be stitched into one stream (same as pigz). the last chunk ends
+ * the stream if finish is set. appends to out and combines the adler32 of the data into adler
+ */
+static bool deflate_chunks(const unsigned char *in, const size_t begin, const size_t end,
+                           const png_settings &settings, const bool finish,
+                           std::vector<unsigned char> &out, uLong &adler) {
+  const size_t insize = end - begin;
+  const size_t chunk = std::max(settings.chunk_size, size_t(1));
+  const size_t n_chunks = std::max((insize + chunk - 1) / chunk, size_t(1));
+  std::vector<std::vector<unsigned char>> deflated(n_chunks);
+  std::vector<uLong> chunk_adler(n_chunks);
+  bool failed = false;
+
+#pragma omp parallel for schedule(dynamic, 1) reduction(|| : failed)
+  for (size_t c = 0; c < n_chunks; c++) {
+    const size_t start = begin + c * chunk;
+    const size_t len = std::min(chunk, end - start);
+    const bool last = finish && c == n_chunks - 1;
+    chunk_adler[c] = adler32(adler32(0, Z_NULL, 0), in + start, uInt(len));
+
+    z_stream stream;
+    std::memset(&stream, 0, sizeof(stream));
+    if (deflateInit2(&stream, settings.level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+      failed = true;
+      continue;
+    }
+    if (start > 0 && settings.level > 0) {
+      const size_t dict = std::min(start, size_t(32768));
+      deflateSetDictionary(&stream, in + start - dict, uInt(dict));
+    }
+    // room for the sync marker and the end of stream on top of the worst case
+    std::vector<unsigned char> &d = deflated[c];
+    d.resize(deflateBound(&stream, uLong(len)) + 16);
+    stream.next_in = const_cast<unsigned char *>(in + start);
+    stream.avail_in = uInt(len);
+    stream.next_out = d.data();
+    stream.avail_out = uInt(d.size());
+    const int ret = deflate(&stream, last ? Z_FINISH : Z_SYNC_FLUSH);
+    if (ret != (last ? Z_STREAM_END : Z_OK) || stream.avail_in != 0) {
+      failed = true;
+    }
+    d.resize(d.size() - stream.avail_out);
+    deflateEnd(&stream);
+  }
+  if (failed) {
+    return false;
+  }
+
+  for (size_t c = 0; c < n_chunks; c++) {
+    const size_t len = std::min(chunk, end - (begin + c * chunk));
+    adler = adler32_combine(adler, chunk_adler[c], z_off_t(len));
+    out.insert(out.end(), deflated[c].begin(), deflated[c].end());
+  }
+  return true;
+}
+
+/** zlib header: 32k window, FLEVEL matching what zlib itself would write */
+static void zlib_header(const int level, std::vector<unsigned char> &out) {
+  out.push_back(0x78);
+  out.push_back(level <= 1 ? 0x01 : level <= 5 ? 0x5e : level == 6 ? 0x9c : 0xda);
+}
+
+static void append_u32(std::vector<unsigned char> &out, const uint32_t n) {
+  out.push_back((unsigned char)(n >> 24));
+  out.push_back((unsigned char)(n >> 16));
+  out.push_back((unsigned char)(n >> 8));
+  out.push_back((unsigned char)(n));
+}
+
+/**
+ * lodepng's custom_zlib, with deflate_chunks. the output is allocated with malloc, lodepng frees it
+ */
+static unsigned parallel_zlib(unsigned char **out, size_t *outsize, const unsigned char *in,
+                              size_t insize, const LodePNGCompressSettings *lode_settings) {
+  const png_settings &settings = *(const png_settings *)lode_settings->custom_context;
+  std::vector<unsigned char> z;
+  zlib_header(settings.level, z);
+  uLong check = adler32(0, Z_NULL, 0);
+  if (!deflate_chunks(in, 0, insize, settings, true, z, check)) {
+    /* lodepng's memory allocation error, the closest one it has */
+    return 83;
+  }
+  append_u32(z, uint32_t(check));
+
+  unsigned char *o = (unsigned char *)malloc(z.size());
+  if (!o) {
+    return 83;
+  }
+  std::memcpy(o, z.data(), z.size());
+  *out = o;
+  *outsize = z.size();
+  return 0;
+}
+
+std::vector<unsigned char> encode_png(const image_RGB &rgb_data, const png_settings &settings) {
+  if (settings.level < 0 || settings.level > 9) {
+    throw std::runtime_error("png compression level must be between 0 and 9");
+  }
+  lodepng::State state;
+  state.info_raw.colortype = LCT_RGB;
+  state.info_raw.bitdepth = 8;
+  // always plain rgb, figuring out a smaller color type is a pass over the whole image
+  state.encoder.auto_convert = 0;
+  state.info_png.color.colortype = LCT_RGB;
+  state.info_png.color.bitdepth = 8;
+  state.encoder.filter_palette_zero = 0;
+  switch (settings.filter) {
+    case PNG_FILTER_ZERO:
+      state.encoder.filter_strategy = LFS_ZERO;
+      break;
+    case PNG_FILTER_MINSUM:
+      state.encoder.filter_strategy = LFS_MINSUM;
+      break;
+    case PNG_FILTER_ENTROPY:
+      state.encoder.filter_strategy = LFS_ENTROPY;
+      break;
+  }
+  state.encoder.zlibsettings.custom_zlib = parallel_zlib;
+  state.encoder.zlibsettings.custom_context = &settings;
+
+  std::vector<unsigned char> png;
+  const unsigned error = lodepng::encode(png, (const unsigned char *)rgb_data.data(),
+                                         unsigned(rgb_data.x()), unsigned(rgb_data.y()), state);
+  if (error) {
+    throw std::runtime_error(std::string("png encoding failed: ") + lodepng_error_text(error));
+  }
+  return png;
+}
+
 void write_image(const image_RGB &rgb_data, const std::string &out_filename) {
-  lodepng::encode(out_filename, (const unsigned char *)rgb_data.data(), rgb_data.x(), rgb_data.y(),
-                  LCT_RGB);
+  write_image(rgb_data, out_filename, png_settings());
 };
 
+void write_image(const image_RGB &rgb_data, const std::string &out_filename,
+                 const png_settings &settings) {
+  const unsigned error = lodepng::save_file(encode_png(rgb_data, settings), out_filename);
+  if (error) {
+    throw std::runtime_error(std::string("could not write ") + out_filename + ": " +
+                             lodepng_error_text(error));
+  }
+}
+
+/** png filter types, from the spec */
+enum png_filter_type : unsigned char {
+  FILTER_NONE,
+  FILTER_SUB,
+  FILTER_UP,
+  FILTER_AVERAGE,
+  FILTER_PAETH,
+};
+
+static inline unsigned char paeth(const int a, const int b, const int c) {
+  const int p = a + b - c;
+  const int pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+  return (unsigned char)(pa <= pb && pa <= pc ? a : pb <= pc ? b : c);
+}
+
+/** row and prev are rgb, out gets the filtered bytes (without the filter type in front) */
+static void filter_row(const png_filter_type type, const unsigned char *row,
+                       const unsigned char *prev, const size_t len, unsigned char *out) {
+  const size_t bpp = 3;
+  const size_t first = std::min(bpp, len);
+  switch (type) {
+    case FILTER_NONE:
+      std::memcpy(out, row, len);
+      break;
+    case FILTER_SUB:
+      std::memcpy(out, row, first);
+      for (size_t i = bpp; i < len; i++) {
+        out[i] = (unsigned char)(row[i] - row[i - bpp]);
+      }
+      break;
+    case FILTER_UP:
+      for (size_t i = 0; i < len; i++) {
+        out[i] = (unsigned char)(row[i] - prev[i]);
+      }
+      break;
+    case FILTER_AVERAGE:
+      for (size_t i = 0; i < first; i++) {
+        out[i] = (unsigned char)(row[i] - (prev[i] >> 1));
+      }
+      for (size_t i = bpp; i < len; i++) {
+        out[i] = (unsigned char)(row[i] - ((row[i - bpp] + prev[i]) >> 1));
+      }
+      break;
+    case FILTER_PAETH:
+      // the left and upper left pixels are 0, which makes the predictor the one above
+      for (size_t i = 0; i < first; i++) {
+        out[i] = (unsigned char)(row[i] - prev[i]);
+      }
+      for (size_t i = bpp; i < len; i++) {
+        out[i] = (unsigned char)(row[i] - paeth(row[i - bpp], prev[i], prev[i - bpp]));
+      }
+      break;
+  }
+}
+
+/** lower is better, the same heuristics as lodepng's LFS_MINSUM and LFS_ENTROPY */
+static double filter_cost(const png_filter strategy, const unsigned char *filtered,
+                          const size_t len) {
+  if (strategy == PNG_FILTER_ENTROPY) {
+    size_t count[256] = {0};
+    for (size_t i = 0; i < len; i++) {
+      count[filtered[i]]++;
+    }
+    double sum = 0;
+    for (size_t n : count) {
+      if (n) {
+        const double p = double(n) / len;
+        sum -= p * std::log2(p);
+      }
+    }
+    return sum;
+  }
+  size_t sum = 0;
+  for (size_t i = 0; i < len; i++) {
+    // signed difference from 0
+    sum += filtered[i] < 128 ? filtered[i] : 256 - filtered[i];
+  }
+  return double(sum);
+}
+
+/** out is 1 + len bytes: the filter type and the filtered row */
+static void filter_row(const png_filter strategy, const unsigned char *row,
+                       const unsigned char *prev, const size_t len, unsigned char *out) {
+  if (strategy == PNG_FILTER_ZERO) {
+    out[0] = FILTER_NONE;
+    std::memcpy(out + 1, row, len);
+    return;
+  }
+  std::vector<unsigned char> attempt(len);
+  double best = 0;
+  for (int type = FILTER_NONE; type <= FILTER_PAETH; type++) {
+    filter_row(png_filter_type(type), row, prev, len, attempt.data());
+    const double cost = filter_cost(strategy, attempt.data(), len);
+    if (type == FILTER_NONE || cost < best) {
+      best = cost;
+      out[0] = (unsigned char)type;
+      std::memcpy(out + 1, attempt.data(), len);
+    }
+  }
+}
+
+png_stream::png_stream(const std::string &path, const size_t width, const size_t height,
+                       const png_settings &settings)
+    : settings(settings), width(width), height(height), previous_row(3 * width, 0) {
+  if (settings.level < 0 || settings.level > 9) {
+    throw std::runtime_error("png compression level must be between 0 and 9");
+  }
+  if (width == 0 || height == 0 || width > 0x7fffffff || height > 0x7fffffff) {
+    throw std::runtime_error("png images must be between 1 and 2^31 - 1 pixels on each side");
+  }
+  file = std::fopen(path.c_str(), "wb");
+  if (!file) {
+    throw std::runtime_error("could not open " + path);
+  }
+  const unsigned char signature[8] = {137, 80, 78, 71, 13, 10, 26, 10};
+  write_bytes(signature, sizeof(signature));
+  std::vector<unsigned char> ihdr;
+  append_u32(ihdr, uint32_t(width));
+  append_u32(ihdr, uint32_t(height));
+  // 8 bit rgb, deflate, adaptive filtering, not interlaced
+  const unsigned char rest[5] = {8, 2, 0, 0, 0};
+  ihdr.insert(ihdr.end(), rest, rest + 5);
+  write_chunk("IHDR", ihdr.data(), ihdr.size());
+  adler = adler32(0, Z_NULL, 0);
+}
+
+png_stream::~png_stream() {
+  if (file) {
+    std::fclose(file);
+  }
+}
+
+void png_stream::write_bytes(const unsigned char *data, const size_t size) {
+  if (std::fwrite(data, 1, size, file) != size) {
+    throw std::runtime_error("could not write png");
+  }
+}
+
+void png_stream::write_chunk(const char *type, const unsigned char *data, const size_t size) {
+  std::vector<unsigned char> header;
+  append_u32(header, uint32_t(size));
+  header.insert(header.end(), type, type + 4);
+  uLong crc = crc32(0, Z_NULL, 0);
+  crc = crc32(crc, header.data() + 4, 4);
+  if (size > 0) {
+    // a null buffer would reset the crc
+    crc = crc32(crc, data, uInt(size));
+  }
+  std::vector<unsigned char> footer;
+  append_u32(footer, uint32_t(crc));
+  write_bytes(header.data(), header.size());
+  write_bytes(data, size);
+  write_bytes(footer.data(), footer.size());
+}
+
+void png_stream::write_idat(const std::vector<unsigned char> &z) {
+  // chunk lengths are 31 bits, crc32 takes 32 bit lengths
+  const size_t max_chunk = size_t(1) << 30;
+  for (size_t pos = 0; pos < z.size(); pos += max_chunk) {
+    write_chunk("IDAT", z.data() + pos, std::min(max_chunk, z.size() - pos));
+  }
+}
+
+void png_stream::write(const image_RGB &rows) {
+  if (!file) {
+    throw std::runtime_error("png_stream is already closed");
+  }
+  if (rows.x() != width) {
+    throw std::runtime_error("every band of a png_stream must be the width of the image");
+  }
+  if (rows_written + rows.y() > height) {
+    throw std::runtime_error("too many rows for png_stream");
+  }
+  const size_t len = 3 * width;
+  const size_t n_rows = rows.y();
+  const unsigned char *data = (const unsigned char *)rows.data();
+
+  // the end of the last band goes in front as the dictionary
+  const size_t begin = window.size();
+  std::vector<unsigned char> filtered(begin + n_rows * (len + 1));
+  std::memcpy(filtered.data(), window.data(), begin);
+#pragma omp parallel for schedule(dynamic, 16)
+  for (size_t y = 0; y < n_rows; y++) {
+    const unsigned char *prev = y == 0 ? previous_row.data() : data + (y - 1) * len;
+    filter_row(settings.filter, data + y * len, prev, len,
+               filtered.data() + begin + y * (len + 1));
+  }
+
+  std::vector<unsigned char> z;
+  if (rows_written == 0) {
+    zlib_header(settings.level, z);
+  }
+  if (!deflate_chunks(filtered.data(), begin, filtered.size(), settings, false, z, adler)) {
+    throw std::runtime_error("png compression failed");
+  }
+  write_idat(z);
+
+  if (n_rows > 0) {
+    std::memcpy(previous_row.data(), data + (n_rows - 1) * len, len);
+  }
+  const size_t keep = std::min(filtered.size(), size_t(32768));
+  window.assign(filtered.end() - keep, filtered.end());
+  rows_written += n_rows;
+}
+
+void png_stream::close() {
+  if (!file) {
+    return;
+  }
+  if (rows_written != height) {
+    throw std::runtime_error("png_stream closed after " + std::to_string(rows_written) + " of " +
+                             std::to_string(height) + " rows");
+  }
+  // an empty last block ends the deflate stream
+  std::vector<unsigned char> z;
+  if (!deflate_chunks(window.data(), window.size(), window.size(), settings, true, z, adler)) {
+    throw std::runtime_error("png compression failed");
+  }
+  append_u32(z, uint32_t(adler));
+  write_idat(z);
+  write_chunk("IEND", nullptr, 0);
+  const bool failed = std::fclose(file) != 0;
+  file = nullptr;
+  if (failed) {
+    throw std::runtime_error("could not write png");
+  }
+}
+
 image_RGB read_image(const std::string &filename) {
   std::vector<unsigned char> data;
   unsigned w, h;
@@ -24,11 +411,79 @@ image_RGB read_image(const std::string &filename) {
   return output;
 }
 
+video_stream::video_stream(const std::string &path, const video_format format,
+                           const size_t framerate)
+    : format(format), framerate(framerate) {
+  if (path == "-") {
+    file = stdout;
+  } else {
+    file = std::fopen(path.c_str(), "wb");
+    if (!file) {
+      throw std::runtime_error("could not open " + path);
+    }
+  }
+}
+
+video_stream::~video_stream() {
+  if (file == stdout) {
+    std::fflush(file);
+  } else {
+    std::fclose(file);
+  }
+}
+
+void video_stream::write(const image_RGB &frame) {
+  if (width == 0) {
+    width = frame.x();
+    height = frame.y();
+    if (format == VIDEO_Y4M) {
+      std::fprintf(file, "YUV4MPEG2 W%zu H%zu F%zu:1 Ip A1:1 C444\n", width, height, framerate);
+      planes.resize(3 * width * height);
+    }
+  }
+  if (frame.x() != width || frame.y() != height) {
+    throw std::runtime_error("every frame of a video must be the same size");
+  }
+
+  const size_t n = width * height;
+  const unsigned char *data = (const unsigned char *)frame.data();
+  const size_t size = 3 * n;
+  if (format == VIDEO_Y4M) {
+    std::fputs("FRAME\n", file);
+    // studio range bt.601, in fixed point
+    unsigned char *y = planes.data(), *u = y + n, *v = u + n;
+    for (size_t i = 0; i < n; i++) {
+      const int r = data[3 * i], g = data[3 * i + 1], b = data[3 * i + 2];
+      y[i] = (unsigned char)(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+      u[i] = (unsigned char)(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+      v[i] = (unsigned char)(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+    }
+    data = planes.data();
+  }
+  if (std::fwrite(data, 1, size, file) != size) {
+    throw std::runtime_error("could not write video frame");
+  }
+}
+
+std::string video_stream::ffmpeg_command(const std::string &path,
+                                         const std::string &output) const {
+  std::stringstream cmd;
+  cmd << "ffmpeg ";
+  if (format == VIDEO_RAW_RGB) {
+    cmd << "-f rawvideo -pix_fmt rgb24 -s " << width << "x" << height << " -framerate "
+        << framerate << " ";
+  }
+  cmd << "-i " << (path == "-" ? "pipe:0" : path) << " -pix_fmt yuv420p " << output;
+  return cmd.str();
+}
+
 void image_sanity_check(const matrix<double> &grid, bool print_minmax) {
   /*checks the output to make sure it looks valid*/
   auto min_max_tuple = std::minmax_element(grid.begin(), grid.end());
-  double min = *min_max_tuple.first;
-  double max = *min_max_tuple.second;
+  image_sanity_check(*min_max_tuple.first, *min_max_tuple.second, print_minmax);
+}
+
+void image_sanity_check(const double min, const double max, bool print_minmax) {
   if (min == INF || min == -INF || max == INF || max == -INF || std::isnan(min) ||
       std::isnan(max)) {
     std::cout << "infinity detected" << std::endl;
@@ -45,8 +500,14 @@ void image_sanity_check(const matrix<double> &grid, bool print_minmax) {
 
 void color_write_image(const matrix<double> &grid, const colormap_func &cmap,
                        const std::string &output_filename, bool write_save) {
+  color_write_image(grid, tile_layout(grid.x(), grid.y()), cmap, output_filename, write_save);
+}
+
+void color_write_image(const matrix<double> &grid, const tile_layout &layout,
+                       const colormap_func &cmap, const std::string &output_filename,
+                       bool write_save) {
   image_RGB color_image(grid.x(), grid.y());
-  grayscale_to_rgb(grid, color_image, cmap);
+  grayscale_to_rgb(grid, layout, color_image, cmap);
   if (write_save) {
     std::cout << "saving image" << std::endl;
   }
@@ -61,6 +522,15 @@ void scale_grid(matrix<double> &grid) {
   grid /= (max - min);
 }
 
+uint64_t fnv1a_hash(const std::string &data) {
+  uint64_t hash = 0xcbf29ce484222325;
+  for (const char c : data) {
+    hash ^= (unsigned char)c;
+    hash *= 0x100000001b3;
+  }
+  return hash;
+}
+
 bool render_exists(const std::string &path, const json &expected) {
   json actual;
   std::ifstream f_image(path);
@@ -1,8 +1,11 @@
 // (c) Copyright 2016 Josh Wright
 #pragma once
 
+#include <cstdint>
+#include <cstdio>
 #include <string>
 #include <fstream>
+#include <vector>
 #include "colormaps.h"
 #include "generators.h"
 #include "types.h"
@@ -11,18 +14,131 @@
 namespace image_utils {
 using json = nlohmann::json;
 
+/** how much work to put into filtering each row of a png before compressing it */
+enum png_filter {
+  /* no filtering, fastest */
+  PNG_FILTER_ZERO,
+  /* lodepng's default, the official png heuristic */
+  PNG_FILTER_MINSUM,
+  PNG_FILTER_ENTROPY,
+};
+
+/**
+ * png encoding options. the image data is deflated in chunks of chunk_size bytes in parallel, which
+ * are stitched into one zlib stream (same as pigz), so the file is readable by anything
+ */
+struct png_settings {
+  /* zlib level, 0 only stores the data and 1 is the fastest compression. 4 is about as fast as
+   * lodepng's own deflate on one core, with smaller files */
+  int level = 4;
+  png_filter filter = PNG_FILTER_MINSUM;
+  size_t chunk_size = 1 << 18;
+
+  /** for intermediate files that are read once, like animation frames */
+  static png_settings fast();
+
+  /** no compression at all */
+  static png_settings store();
+};
+
 void write_image(const image_RGB &rgb_data, const std::string &out_filename);
 
+void write_image(const image_RGB &rgb_data, const std::string &out_filename,
+                 const png_settings &settings);
+
+std::vector<unsigned char> encode_png(const image_RGB &rgb_data, const png_settings &settings);
+
 image_RGB read_image(const std::string &filename);
 
+enum video_format {
+  /* YUV4MPEG2 with 4:4:4 bt.601 frames, ffmpeg and most encoders read it without any options */
+  VIDEO_Y4M,
+  /* bare rgb24 frames, the reader has to be told the size and frame rate */
+  VIDEO_RAW_RGB,
+};
+
+/**
+ * uncompressed video written frame by frame to a file, a named pipe, or stdout ("-"), to feed a
+ * video encoder directly instead of going through png files. the size is taken from the first frame
+ */
+class video_stream {
+  FILE *file;
+  video_format format;
+  size_t framerate;
+  size_t width = 0, height = 0;
+  /* one frame of y, u and v planes */
+  std::vector<unsigned char> planes;
+
+ public:
+  video_stream(const std::string &path, const video_format format, const size_t framerate);
+
+  video_stream(const video_stream &) = delete;
+  video_stream &operator=(const video_stream &) = delete;
+
+  ~video_stream();
+
+  void write(const image_RGB &frame);
+
+  /** command line to turn this stream into an mp4 with ffmpeg */
+  std::string ffmpeg_command(const std::string &path, const std::string &output) const;
+};
+
+/**
+ * png written a band of rows at a time, for images too big to keep in memory. each band is filtered
+ * and deflated like encode_png does it and goes straight to the file, so only the band being written
+ * and the end of the one before it are kept around. close() has to be called after the last row
+ */
+class png_stream {
+  FILE *file;
+  png_settings settings;
+  size_t width, height;
+  size_t rows_written = 0;
+  /* the last row so far, unfiltered, for the filters that look at the row above */
+  std::vector<unsigned char> previous_row;
+  /* the last 32k of filtered data so far, the dictionary of the next band */
+  std::vector<unsigned char> window;
+  /* of all the filtered data so far */
+  unsigned long adler;
+
+  void write_bytes(const unsigned char *data, const size_t size);
+  void write_chunk(const char *type, const unsigned char *data, const size_t size);
+  void write_idat(const std::vector<unsigned char> &z);
+
+ public:
+  png_stream(const std::string &path, const size_t width, const size_t height,
+             const png_settings &settings = png_settings());
+
+  png_stream(const png_stream &) = delete;
+  png_stream &operator=(const png_stream &) = delete;
+
+  /** doesn't finish the image, the file is left truncated if close wasn't called */
+  ~png_stream();
+
+  /** the next rows.y() rows of the image, any number at a time */
+  void write(const image_RGB &rows);
+
+  /** throws if fewer than height rows were written */
+  void close();
+};
+
 void image_sanity_check(const matrix<double> &grid, bool print_minmax = false);
 
+/** same checks, for a range that is already known */
+void image_sanity_check(const double min, const double max, bool print_minmax = false);
+
 void color_write_image(const matrix<double> &grid, const colormap_func &cmap,
                        const std::string &output_filename, bool write_save = true);
 
+void color_write_image(const matrix<double> &grid, const tile_layout &layout,
+                       const colormap_func &cmap, const std::string &output_filename,
+                       bool write_save = true);
+
 void scale_grid(matrix<double> &grid);
 
 void scale_iteration_grid_histogram(matrix<double> &grid, const size_t bins);
 
 bool render_exists(const std::string &path, const json &expected);
+
+/** 64 bit FNV-1a, to tell render settings apart without storing all of them */
+uint64_t fnv1a_hash(const std::string &data);
 }
@@ -1,6 +1,7 @@
 // (c) Copyright 2016 Josh Wright
 
 #include "types.h"
+#include <algorithm>
 
 namespace image_utils {
 
@@ -20,25 +21,43 @@ RGB vec3_to_RGB(const vec3 &v) {
 
 matrix<RGB> image_vec3_to_RGB(const matrix<vec3> &m) {
   matrix<RGB> out_rgb(m.x(), m.y());
-  std::transform(m.begin(), m.end(), out_rgb.begin(), [](const vec3 &in) {
-    RGB out;
-    out.r = in[0];
-    out.g = in[1];
-    out.b = in[2];
-    return out;
-  });
+  const vec3 *in = m.data();
+  RGB *out = out_rgb.data();
+  const size_t n = m.size();
+#pragma omp parallel for schedule(static)
+  for (size_t i = 0; i < n; i++) {
+    out[i].r = in[i][0];
+    out[i].g = in[i][1];
+    out[i].b = in[i][2];
+  }
   return out_rgb;
 }
 
 matrix<vec3> image_RGB_to_vec3(const matrix<RGB> &m) {
   matrix<vec3> out_vec3(m.x(), m.y());
-  std::transform(m.begin(), m.end(), out_vec3.begin(), [](const RGB &in) {
-    vec3 out;
-    out[0] = in.r;
-    out[1] = in.g;
-    out[2] = in.b;
-    return out;
-  });
+  const RGB *in = m.data();
+  vec3 *out = out_vec3.data();
+  const size_t n = m.size();
+#pragma omp parallel for schedule(static)
+  for (size_t i = 0; i < n; i++) {
+    out[i][0] = in[i].r;
+    out[i][1] = in[i].g;
+    out[i][2] = in[i].b;
+  }
   return out_vec3;
 }
+
+matrix<double> untile(const matrix<double> &in, const tile_layout &layout) {
+  matrix<double> out(in.x(), in.y());
+  // each row of a tile is contiguous
+  const size_t step = layout.linear() ? in.x() : layout.tile;
+  for (size_t y = 0; y < in.y(); y++) {
+    for (size_t x0 = 0; x0 < in.x(); x0 += step) {
+      const size_t len = std::min(step, in.x() - x0);
+      std::memcpy(out.data() + y * in.x() + x0, in.data() + layout.index(x0, y),
+                  len * sizeof(double));
+    }
+  }
+  return out;
+}
 }
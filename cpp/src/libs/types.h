@@ -7,6 +7,7 @@
 
 #include <complex>
 #include <cstring>
+#include <stdexcept>
 #include "util/matrix.h"
 #include "util/vect.h"
 
@@ -124,5 +125,47 @@ typedef matrix<RGBAd> image_RGBAd;
 typedef matrix<grayscaled> image_gsd;
 
 typedef std::complex<double> complex;
+
+/**
+ * where element (x, y) of a w x h grid is stored. either plain rows, or square tiles of rows
+ * (tile must be a power of 2), with the tiles themselves stored in rows. tiles on the right and
+ * bottom edges are cropped, so a tiled grid still has exactly w*h elements.
+ *
+ * tiles keep rectangles that are close together in the image close together in memory, which
+ * helps with walking vertical edges of very large images.
+ */
+struct tile_layout {
+  size_t w = 0, h = 0;
+  /* 0 for plain rows */
+  size_t tile = 0;
+  size_t shift = 0;
+
+  tile_layout() {}
+
+  tile_layout(const size_t w, const size_t h, const size_t tile = 0) : w(w), h(h), tile(tile) {
+    while (tile && (size_t(1) << shift) < tile) {
+      shift++;
+    }
+    if (tile && (size_t(1) << shift) != tile) {
+      throw std::runtime_error("tile size must be a power of 2");
+    }
+  }
+
+  bool linear() const { return tile == 0; }
+
+  size_t index(const size_t x, const size_t y) const {
+    if (!tile) {
+      return x + y * w;
+    }
+    const size_t x0 = (x >> shift) << shift;
+    const size_t y0 = (y >> shift) << shift;
+    const size_t tile_w = w - x0 < tile ? w - x0 : tile;
+    const size_t tile_h = h - y0 < tile ? h - y0 : tile;
+    return y0 * w + x0 * tile_h + (y - y0) * tile_w + (x - x0);
+  }
+};
+
+/** copy a grid stored with layout into plain rows */
+matrix<double> untile(const matrix<double> &in, const tile_layout &layout);
 }
 #endif  // IMAGE_STUFF_TYPES_H
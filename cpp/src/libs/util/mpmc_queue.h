@@ -0,0 +1,113 @@
+// (c) Copyright 2017 Josh Wright
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace image_utils {
+
+/**
+ * bounded lock-free queue for any number of producers and consumers (Dmitry Vyukov's). every cell
+ * has a sequence number saying whether it is ready to be written or read for the current lap, so
+ * producers and consumers only contend on their own position counter.
+ *
+ * capacity must be a power of 2
+ */
+template <typename T>
+class mpmc_queue {
+  struct cell {
+    std::atomic<size_t> sequence;
+    T value;
+  };
+
+  std::vector<cell> cells;
+  const size_t mask;
+  /* keep the two counters on their own cache lines */
+  alignas(64) std::atomic<size_t> head{0};
+  alignas(64) std::atomic<size_t> tail{0};
+
+  /** spin a little, then give the core away */
+  static void backoff(size_t &spins) {
+    if (++spins < 64) {
+      std::this_thread::yield();
+    } else {
+      std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+  }
+
+ public:
+  explicit mpmc_queue(const size_t capacity) : cells(capacity), mask(capacity - 1) {
+    if (capacity < 2 || (capacity & (capacity - 1)) != 0) {
+      throw std::runtime_error("queue capacity must be a power of 2");
+    }
+    for (size_t i = 0; i < capacity; i++) {
+      cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  mpmc_queue(const mpmc_queue &) = delete;
+  mpmc_queue &operator=(const mpmc_queue &) = delete;
+
+  /** false if the queue is full */
+  bool try_push(const T &value) {
+    size_t pos = tail.load(std::memory_order_relaxed);
+    for (;;) {
+      cell &c = cells[pos & mask];
+      const size_t seq = c.sequence.load(std::memory_order_acquire);
+      const ptrdiff_t diff = ptrdiff_t(seq) - ptrdiff_t(pos);
+      if (diff == 0) {
+        if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          c.value = value;
+          c.sequence.store(pos + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = tail.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  /** false if the queue is empty */
+  bool try_pop(T &value) {
+    size_t pos = head.load(std::memory_order_relaxed);
+    for (;;) {
+      cell &c = cells[pos & mask];
+      const size_t seq = c.sequence.load(std::memory_order_acquire);
+      const ptrdiff_t diff = ptrdiff_t(seq) - ptrdiff_t(pos + 1);
+      if (diff == 0) {
+        if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          value = c.value;
+          c.sequence.store(pos + mask + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = head.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  void push(const T &value) {
+    size_t spins = 0;
+    while (!try_push(value)) {
+      backoff(spins);
+    }
+  }
+
+  T pop() {
+    T value;
+    size_t spins = 0;
+    while (!try_pop(value)) {
+      backoff(spins);
+    }
+    return value;
+  }
+};
+};
@@ -10,6 +10,8 @@
 #include "fractal/fractal_common.h"
 #include "fractal/fractal_avx.h"
 #include "fractal/fractal_info.h"
+#include "fractal/fractal_perturbation.h"
+#include "fractal/post_process.h"
 #include "generators.h"
 #include "io.h"
 #include "util/arg_parser.h"
@@ -24,10 +26,23 @@ int main(int argc, char const *argv[]) {
                    {"cr, ci", "julia initial value"},
                    {"mul", "distance multiplier"},
                    {"subsample", "split each pixel 2x2 and average"},
+                   {"distance", "distance estimate instead of iterations, crisp without subsample"},
+                   {"aa_samples", "extra jittered samples for pixels on edges (adaptive antialiasing)"},
+                   {"aa_threshold", "difference in log2 iterations that counts as an edge"},
                    {"iter", "number of iteraitons"},
                    {"smooth", "smooth between iterations"},
                    {"output", "output file to write to"},
                    {"color", "colormap to use"},
+                   {"poly", "polynomial name, or an expression in z and c like \"z^3 + c/z\""},
+                   {"simd", "vectorized double precision kernel (standard and cubic polynomials)"},
+                   {"fma", "fused multiply-add with simd, faster but rounds slightly differently"},
+                   {"avx", "single precision preview (standard polynomial only)"},
+                   {"interior", "detect points inside the set early (default 1)"},
+                   {"border_trace", "trace the borders of regions instead of splitting rectangles"},
+                   {"tile", "store iterations in square tiles of this size, for huge images"},
+                   {"perturbation", "iterate against a reference orbit, for deep zooms"},
+                   {"series_terms", "series approximation terms for perturbation (0 to disable)"},
+                   {"progressive", "write quick previews at 1/16 and 1/4 of the pixels first"},
                },
                3, 10);
   arg_parser args(argc, argv);
@@ -42,14 +57,58 @@ int main(int argc, char const *argv[]) {
   }
 
   std::cout << json(cfg) << std::endl;
+  if (std::dynamic_pointer_cast<fractal_avx_f32>(fractal) ||
+      std::dynamic_pointer_cast<fractal_avx_f64>(fractal)) {
+    std::cout << "instruction set: " << simd_isa_name(detect_simd_isa()) << std::endl;
+  }
+
+  std::string outfile = args.read<std::string>("output", "output.png");
+  post_process_settings post;
+  post.sine_mul = cfg.mul;
+  post.distance = cfg.distance;
+  post.distance_mul = cfg.mul;
+  const colormap_lut lut(read_colormap_from_string(cfg.color));
+  image_RGB color_image(cfg.x, cfg.y);
 
-  fractal->run();
+  // transformed along with the coloring below, except that the grid has to be painted over the
+  // transformed iterations, so the fractal does the transform itself then
+  fractal->do_sine_transform = cfg.do_grid;
+  post_process_settings finished = post;
+  if (cfg.do_grid) {
+    finished.log = false;
+    finished.sine = false;
+    finished.distance = false;
+  }
+  if (args.read<int>("progressive", 0) != 0) {
+    fractal->run_progressive([&](const size_t stride) {
+      if (stride > 1) {
+        post_process(fractal->iterations, fractal->layout, post, lut, color_image);
+        write_image(color_image, outfile, png_settings::fast());
+        std::cout << "preview 1/" << stride * stride << " written" << std::endl;
+      }
+      return true;
+    });
+  } else {
+    fractal->run();
+  }
+  if (auto p = std::dynamic_pointer_cast<fractal_perturbation>(fractal)) {
+    std::cout << "reference orbit: " << p->reference_length << " skipped: " << p->skipped_iterations
+              << " rebases: " << p->rebases << std::endl;
+  }
 
-  image_sanity_check(fractal->iterations, true);
-  scale_grid(fractal->iterations);
+  if (fractal->antialiased_pixels > 0) {
+    std::cout << "antialiased: " << fractal->antialiased_pixels << std::endl;
+  }
+  if (fractal->iterated_pixels > 0) {
+    std::cout << "iterated: " << fractal->iterated_pixels << " filled: " << fractal->filled_pixels
+              << std::endl;
+  }
 
-  std::string outfile = args.read<std::string>("output", "output.png");
-  color_write_image(fractal->iterations, read_colormap_from_string(cfg.color), outfile);
+  post_process_stats stats =
+      post_process(fractal->iterations, fractal->layout, finished, lut, color_image);
+  image_sanity_check(stats.min, stats.max, true);
+  std::cout << "saving image" << std::endl;
+  write_image(color_image, outfile);
   // write metadata file
   std::ofstream f(outfile + ".json");
   f << json(cfg) << std::endl;
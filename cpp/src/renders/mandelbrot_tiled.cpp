@@ -6,6 +6,7 @@ using namespace boost::multiprecision;
 using namespace boost::math;
 using namespace boost::math::tools;
 
+#include <algorithm>
 #include <fstream>
 #include <functional>
 #include <iomanip>
@@ -34,10 +35,56 @@ static inline int sgn(int i) {
 
 std::string to_string(const mpf_float &n) {
   std::stringstream ss;
-  ss << n;
+  // all the digits, the default of 6 would move the tiles
+  ss << std::setprecision(n.precision()) << n;
   return ss.str();
 }
 
+/**
+ * the whole image (n tiles across and down) rendered a band of rows at a time and written straight
+ * into one png, so memory use is one band of iterations and colors no matter how big the image is
+ */
+static void render_stream(const fractal_info &cfg, const size_t n,
+                          const size_t band_rows, const std::string &outfile) {
+  using namespace image_utils;
+  const size_t width = cfg.x * n;
+  const size_t height = cfg.y * n;
+  const mpf_float cfg_r = numeric_from_string<mpf_float>(cfg.r);
+  const mpf_float cfg_i = numeric_from_string<mpf_float>(cfg.i);
+  const mpf_float zoom = numeric_from_string<mpf_float>(cfg.zoom);
+  auto bounds =
+      fractal_impl<mpf_float>::calc_bounds(width, height, vect<mpf_float, 2>{cfg_r, cfg_i}, zoom);
+  const mpf_float half_width = (bounds[1] - bounds[0]) / 2;
+  const mpf_float pixel_height = (bounds[3] - bounds[2]) / height;
+  const colormap_func cmap = read_colormap_from_string(cfg.color);
+
+  png_stream png(outfile, width, height);
+  for (size_t y0 = 0; y0 < height; y0 += band_rows) {
+    const size_t rows = std::min(band_rows, height - y0);
+    fractal_info band = cfg;
+    band.x = width;
+    band.y = rows;
+    band.r = to_string(cfg_r);
+    band.i = to_string(bounds[3] - pixel_height * (mpf_float(y0) + mpf_float(rows) / 2));
+    // calc_bounds fits 2 / zoom to the shorter side, the band has to be as wide as the image
+    band.zoom = to_string(width > rows ? mpf_float(2) * width / (half_width * rows)
+                                       : mpf_float(2) / half_width);
+
+    fractal_ref fractal = get_fractal(band);
+    fractal->run_multithread();
+    image_RGB colors(width, rows);
+    grayscale_to_rgb(fractal->iterations, fractal->layout, colors, cmap);
+    png.write(colors);
+    std::cout << "rows " << y0 + rows << "/" << height << std::endl;
+  }
+  png.close();
+
+  json metadata = json(cfg);
+  metadata["n"] = n;
+  std::ofstream f(outfile + ".json");
+  f << metadata << std::endl;
+}
+
 int main(int argc, char const *argv[]) {
   using namespace image_utils;
   help_printer(argc, argv,
@@ -53,12 +100,19 @@ int main(int argc, char const *argv[]) {
                    {"output", "output file to write to"},
                    {"color", "colormap to use"},
                    {"n", "how many tiles to use"},
+                   {"stream", "render rows of the whole image straight into one png, no montage"},
+                   {"band", "rows per band with stream (default: height of a tile)"},
                },
                3, 10);
   arg_parser args(argc, argv);
   fractal_info cfg = parse_args<fractal_info>(argc, argv);
   std::string base_outfile = args.read<std::string>("output", "output");
   size_t n = args.read<size_t>("n", 2);
+  if (args.read<int>("stream", 0) != 0) {
+    const size_t band_rows = std::max(args.read<size_t>("band", cfg.y), size_t(1));
+    render_stream(cfg, n, band_rows, base_outfile + ".png");
+    return 0;
+  }
   mpf_float zoom = numeric_from_string<mpf_float>(cfg.zoom) * n;
   mpf_float cfg_r = numeric_from_string<mpf_float>(cfg.r);
   mpf_float cfg_i = numeric_from_string<mpf_float>(cfg.i);
@@ -96,7 +150,8 @@ int main(int argc, char const *argv[]) {
 
           image_sanity_check(fractal->iterations, true);
 
-          color_write_image(fractal->iterations, read_colormap_from_string(cfg2.color), outfile);
+          color_write_image(fractal->iterations, fractal->layout,
+                            read_colormap_from_string(cfg2.color), outfile);
           // write metadata file
           std::ofstream f(outfile + ".json");
           f << json(cfg2) << std::endl;
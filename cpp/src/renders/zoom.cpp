@@ -2,6 +2,7 @@
 
 #include "util/arg_parser.h"
 #include <fractal/fractal_animation_zoom.h>
+#include "fractal/fractal_info.h"
 #include <functional>
 #include <iomanip>
 #include <iostream>
@@ -23,31 +24,39 @@ int main(int argc, char const *argv[]) {
                              {"output", "output file to write to"},
                              {"color", "colormap to use"},
                              {"max_zoom", ""},
+                             {"keyframe_scale", "resample frames from keyframes this much larger (1 for off)"},
+                             {"simd", "vectorized double precision kernel (standard and cubic polynomials)"},
+                             {"fma", "fused multiply-add with simd, faster but rounds slightly differently"},
+                             {"perturbation", "use a reference orbit for zooms past 1e13"},
+                             {"bits", "minimum precision of the reference orbit"},
                              {"skip", "skip number of frames at beginning"},
+                             {"resume", "skip frames that a previous run finished (default 1)"},
+                             {"stream", "write y4m video to this file or pipe (- for stdout) instead of pngs"},
+                             {"raw", "stream raw rgb24 frames instead of y4m"},
+                             {"framerate", "frame rate of the video"},
+                             {"parallel_frames", "frames rendered at once (default from the size)"},
+                             {"threads_per_frame", "threads for each frame (default from the size)"},
                      },
                      3, 10);
         arg_parser args(argc, argv);
+        fractal_info cfg = parse_args<fractal_info>(argc, argv);
+        cfg.r = args.read<std::string>("r", "-0.743643887037151");
+        cfg.i = args.read<std::string>("i", "0.131825904205330");
+        cfg.iter = args.read<size_t>("iter", 2048);
+        cfg.mul = args.read<double>("mul", 2);
 
-        auto animation_zoom = make_shared<fractal_animation_zoom>(
-                args.read("x", 500),
-                args.read("y", 500));
+        auto animation_zoom = make_shared<fractal_animation_zoom>(cfg);
         args.read_into(animation_zoom->max_zoom, "max_zoom", 1e13);
-        animation_zoom->center = vec2{
-                args.read<double>("r", -0.743643887037151),
-                args.read<double>("i", 0.131825904205330),
-        };
         animation_zoom->cmap = read_colormap_from_string(args.read<std::string>("color", "hot"));
         animation_zoom->cmap.black_zero = false;
-
-        args.read_bool(animation_zoom->prototype.smooth, "smooth");
-        args.read_into(animation_zoom->prototype.max_iterations, "iter", 2048);
-        args.read_into(animation_zoom->prototype.mul, "mul", 2);
+        args.read_into(animation_zoom->keyframe_scale, "keyframe_scale", 1);
 
         /* TODO subsampling render decorator */
 
         fractal_animator animator(animation_zoom);
         args.read_into(animator.n_frames, "n_frames", 200);
         args.read_into(animator.progress, "skip", 0);
+        args.read_into(animator.resume, "resume", true);
 
         /*todo create output folder if it doesn't exist*/
         auto output_folder = args.read<std::string>("output_folder", "zoom_frames");
@@ -55,6 +64,13 @@ int main(int argc, char const *argv[]) {
                 output_folder.push_back('/');
         }
         animator.output_folder = output_folder;
+        animator.stream_output = args.read<std::string>("stream", "");
+        if (args.read<bool>("raw", false)) {
+                animator.stream_format = VIDEO_RAW_RGB;
+        }
+        args.read_into(animator.framerate, "framerate", 60);
+        args.read_into(animator.parallel_frames, "parallel_frames", 0);
+        args.read_into(animator.threads_per_frame, "threads_per_frame", 0);
         animator.run();
 
         return 0;
@@ -0,0 +1,166 @@
+// (c) Copyright 2017 Josh Wright
+#pragma once
+
+#include <gtest/gtest.h>
+#include <atomic>
+#include <cstdio>
+#include "fractal/fractal_animation_zoom.h"
+#include "fractal/fractal_animator.h"
+
+using namespace image_utils;
+
+struct counting_animation : animation {
+  std::atomic<size_t> renders{0};
+  int setting = 0;
+
+  struct counting_worker : worker {
+    counting_animation &p;
+    image_RGB image{16, 8};
+    counting_worker(counting_animation &p) : p(p) {}
+    void render(double t) override {
+      ++p.renders;
+      std::fill(image.begin(), image.end(), RGB{(unsigned char)(255 * t), 0, 0});
+    }
+    image_RGB &get_color_image() override { return image; }
+  };
+
+  worker_ref get_worker() override { return std::make_shared<counting_worker>(*this); }
+
+  json parameters() const override {
+    json j;
+    j["setting"] = setting;
+    return j;
+  }
+};
+
+TEST(fractal_animator, ResumeFromManifest) {
+  auto anim = std::make_shared<counting_animation>();
+  fractal_animator animator(anim);
+  animator.output_folder = testing::TempDir();
+  animator.out_filename_prefix = "resume_test_";
+  animator.n_frames = 6;
+  std::remove(animator.manifest_filename().c_str());
+
+  animator.run();
+  ASSERT_EQ(6u, anim->renders);
+
+  // nothing left to do
+  animator.run();
+  ASSERT_EQ(6u, anim->renders);
+
+  // a missing frame is rendered again
+  std::remove(animator.frame_filename(3).c_str());
+  animator.run();
+  ASSERT_EQ(7u, anim->renders);
+
+  // so is everything after the parameters change
+  anim->setting = 1;
+  animator.run();
+  ASSERT_EQ(13u, anim->renders);
+
+  animator.resume = false;
+  animator.run();
+  ASSERT_EQ(19u, anim->renders);
+
+  for (size_t i = 0; i < animator.n_frames; i++) {
+    std::remove(animator.frame_filename(i).c_str());
+  }
+  std::remove(animator.manifest_filename().c_str());
+}
+
+TEST(fractal_animation_zoom, FrameAtKeyframeZoomIsExact) {
+  fractal_info cfg;
+  cfg.x = 64;
+  cfg.y = 48;
+  cfg.iter = 500;
+  cfg.smooth = true;
+  cfg.r = "-0.743643887037151";
+  cfg.i = "0.131825904205330";
+  // distance estimates have to be converted to pixels of the frame
+  for (const bool distance : {false, true}) {
+    cfg.distance = distance;
+    auto rendered = std::make_shared<fractal_animation_zoom>(cfg);
+    rendered->max_zoom = 64;
+    auto reprojected = std::make_shared<fractal_animation_zoom>(cfg);
+    reprojected->max_zoom = 64;
+    reprojected->keyframe_scale = 2;
+    worker_ref a = rendered->get_worker();
+    worker_ref b = reprojected->get_worker();
+    // zoom 1 and 8 are keyframes, whose pixels line up exactly with every other pixel of the frame
+    for (double t : {0.0, 0.5}) {
+      a->render(t);
+      b->render(t);
+      image_RGB &ia = a->get_color_image();
+      image_RGB &ib = b->get_color_image();
+      for (size_t i = 0; i < ia.size(); i++) {
+        ASSERT_EQ(ia.data()[i], ib.data()[i]) << distance << " " << t << " " << i;
+      }
+    }
+  }
+}
+
+TEST(fractal_animation_zoom, WorkersOnDifferentKeyframes) {
+  fractal_info cfg;
+  cfg.x = 32;
+  cfg.y = 24;
+  cfg.iter = 200;
+  cfg.r = "-0.743643887037151";
+  cfg.i = "0.131825904205330";
+  auto anim = std::make_shared<fractal_animation_zoom>(cfg);
+  anim->max_zoom = 64;
+  anim->keyframe_scale = 2;
+  worker_ref ahead = anim->get_worker();
+  worker_ref behind = anim->get_worker();
+  ahead->render(0.9);
+  behind->render(0.1);
+  ahead->render(1.0);
+  behind->render(0.2);
+  auto fresh = std::make_shared<fractal_animation_zoom>(cfg);
+  fresh->max_zoom = 64;
+  fresh->keyframe_scale = 2;
+  worker_ref expected = fresh->get_worker();
+  expected->render(0.2);
+  image_RGB &ie = expected->get_color_image();
+  image_RGB &ib = behind->get_color_image();
+  for (size_t i = 0; i < ie.size(); i++) {
+    ASSERT_EQ(ie.data()[i], ib.data()[i]) << i;
+  }
+}
+
+TEST(fractal_animation_zoom, KeyframeTooSmall) {
+  fractal_info cfg;
+  cfg.x = 1;
+  cfg.y = 16;
+  auto anim = std::make_shared<fractal_animation_zoom>(cfg);
+  anim->keyframe_scale = 1.2;
+  ASSERT_THROW(anim->get_worker(), std::runtime_error);
+  anim->keyframe_scale = 2;
+  ASSERT_NO_THROW(anim->get_worker());
+}
+
+TEST(fractal_animator, PlanThreads) {
+  fractal_animator animator(std::make_shared<counting_animation>());
+  // small frames, one thread each
+  thread_plan plan = animator.plan_threads(320 * 240, 16);
+  ASSERT_EQ(16u, plan.frames);
+  ASSERT_EQ(1u, plan.threads_per_frame);
+  plan = animator.plan_threads(1920 * 1080, 16);
+  ASSERT_EQ(2u, plan.frames);
+  ASSERT_EQ(8u, plan.threads_per_frame);
+  // one huge frame at a time
+  plan = animator.plan_threads(7680 * 4320, 16);
+  ASSERT_EQ(1u, plan.frames);
+  ASSERT_EQ(16u, plan.threads_per_frame);
+
+  animator.parallel_frames = 4;
+  plan = animator.plan_threads(7680 * 4320, 16);
+  ASSERT_EQ(4u, plan.frames);
+  ASSERT_EQ(4u, plan.threads_per_frame);
+  animator.threads_per_frame = 3;
+  plan = animator.plan_threads(100, 16);
+  ASSERT_EQ(4u, plan.frames);
+  ASSERT_EQ(3u, plan.threads_per_frame);
+  animator.parallel_frames = 0;
+  plan = animator.plan_threads(100, 16);
+  ASSERT_EQ(5u, plan.frames);
+}
@@ -0,0 +1,58 @@
+// (c) Copyright 2017 Josh Wright
+#pragma once
+
+#include <gtest/gtest.h>
+#include "FractalTestConfig.h"
+#include "fractal/fractal_impl.h"
+
+using namespace image_utils;
+
+TEST(antialias, OnlyEdgesChange) {
+  fractal_info cfg = seahorse_cfg();
+  fractal_impl<double> plain(cfg.x, cfg.y);
+  plain.read_config(cfg);
+  plain.do_sine_transform = false;
+  plain.run();
+  ASSERT_EQ(0u, plain.antialiased_pixels);
+
+  cfg.aa_samples = 16;
+  fractal_impl<double> aa(cfg.x, cfg.y);
+  aa.read_config(cfg);
+  aa.do_sine_transform = false;
+  aa.run();
+  ASSERT_GT(aa.antialiased_pixels, 0u);
+  ASSERT_LT(aa.antialiased_pixels, cfg.x * cfg.y / 2);
+
+  size_t changed = 0;
+  for (size_t x = 0; x < cfg.x; x++) {
+    for (size_t y = 0; y < cfg.y; y++) {
+      if (plain.cell(x, y) != aa.cell(x, y)) {
+        changed++;
+        // neighbors of changed pixels are the ones that triggered it
+        bool edge = false;
+        if (x > 0) edge |= plain.needs_antialiasing(plain.cell(x, y), plain.cell(x - 1, y));
+        if (x + 1 < cfg.x) edge |= plain.needs_antialiasing(plain.cell(x, y), plain.cell(x + 1, y));
+        if (y > 0) edge |= plain.needs_antialiasing(plain.cell(x, y), plain.cell(x, y - 1));
+        if (y + 1 < cfg.y) edge |= plain.needs_antialiasing(plain.cell(x, y), plain.cell(x, y + 1));
+        ASSERT_TRUE(edge) << x << "," << y;
+      }
+    }
+  }
+  ASSERT_LE(changed, aa.antialiased_pixels);
+}
+
+TEST(antialias, SameOnEveryThreadCount) {
+  fractal_info cfg = seahorse_cfg();
+  cfg.aa_samples = 5;
+  cfg.aa_threshold = 0.05;
+  fractal_impl<double> a(cfg.x, cfg.y);
+  a.read_config(cfg);
+  a.run_singlethread();
+  fractal_impl<double> b(cfg.x, cfg.y);
+  b.read_config(cfg);
+  b.run_multithread();
+  ASSERT_EQ(a.antialiased_pixels, b.antialiased_pixels);
+  for (size_t i = 0; i < a.iterations.size(); i++) {
+    ASSERT_EQ(a.iterations.data()[i], b.iterations.data()[i]) << i;
+  }
+}
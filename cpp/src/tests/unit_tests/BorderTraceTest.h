@@ -0,0 +1,57 @@
+// (c) Copyright 2017 Josh Wright
+#pragma once
+
+#include <gtest/gtest.h>
+#include "FractalTestConfig.h"
+#include "fractal/fractal_impl.h"
+
+using namespace image_utils;
+
+/* pixels of a border traced render that differ from calculating every pixel */
+static size_t count_border_trace_mismatches(fractal_impl<double> &f) {
+  size_t fails = 0;
+  for (size_t i = 0; i < f.iterations.x(); i++) {
+    for (size_t j = 0; j < f.iterations.y(); j++) {
+      if (f.iterations(i, j) != f.iterate_cell(f.index_to_complex(vec_ull{i, j}))) {
+        fails++;
+      }
+    }
+  }
+  return fails;
+}
+
+TEST(border_trace, FillsMostOfTheImage) {
+  fractal_info cfg;
+  // not a multiple of the tile size
+  cfg.x = 300;
+  cfg.y = 170;
+  cfg.iter = 1000;
+  cfg.r = "-0.5";
+  cfg.border_trace = true;
+  for (bool multithread : {false, true}) {
+    fractal_impl<double> f(cfg.x, cfg.y);
+    f.read_config(cfg);
+    f.do_sine_transform = false;
+    if (multithread) {
+      f.run_multithread();
+    } else {
+      f.run_singlethread();
+    }
+    ASSERT_EQ(0u, count_border_trace_mismatches(f));
+    ASSERT_EQ(cfg.x * cfg.y, f.iterated_pixels + f.filled_pixels);
+    ASSERT_GT(f.filled_pixels, f.iterated_pixels);
+  }
+}
+
+TEST(border_trace, DetailedView) {
+  fractal_info cfg = seahorse_cfg(200, 150);
+  cfg.iter = 3000;
+  cfg.smooth = false;
+  cfg.border_trace = true;
+  fractal_impl<double> f(cfg.x, cfg.y);
+  f.read_config(cfg);
+  f.do_sine_transform = false;
+  f.run_multithread();
+  // thin filaments can slip between calculated pixels, same as with rectangles
+  ASSERT_GE(cfg.x * cfg.y * 0.001, count_border_trace_mismatches(f));
+}
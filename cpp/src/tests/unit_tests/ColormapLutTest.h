@@ -0,0 +1,74 @@
+// (c) Copyright 2017 Josh Wright
+#pragma once
+
+#include <gtest/gtest.h>
+#include <cmath>
+#include <cstdlib>
+#include "colormaps.h"
+
+using namespace image_utils;
+
+TEST(colormap_lut, CloseToColormap) {
+  const colormap cmap = read_colormap_from_string("hot");
+  const colormap_lut lut(cmap);
+  for (int i = -3000; i <= 3000; i++) {
+    const double x = i / 1000.0 + 0.0001;
+    const RGB a = cmap(x);
+    const RGB b = lut(x);
+    ASSERT_LE(std::abs(a.r - b.r), 2) << x;
+    ASSERT_LE(std::abs(a.g - b.g), 2) << x;
+    ASSERT_LE(std::abs(a.b - b.b), 2) << x;
+  }
+  ASSERT_EQ(cmap(0.0), lut(0.0));
+  ASSERT_EQ(cmap(NAN), lut(NAN));
+}
+
+TEST(colormap_lut, MapSameAsScalar) {
+  const colormap_lut lut(read_colormap_from_string("sine", 7));
+  // odd length for the vector tail
+  std::vector<double> in(1003);
+  for (size_t i = 0; i < in.size(); i++) {
+    in[i] = std::sin(i * 0.37) * 1.7;
+  }
+  in[5] = 0;
+  in[10] = NAN;
+  in[11] = -0.0;
+  in[12] = 1;
+  in[13] = 1e300;
+  std::vector<RGB> out(in.size());
+  lut.map(in.data(), in.size(), out.data());
+  for (size_t i = 0; i < in.size(); i++) {
+    ASSERT_EQ(lut(in[i]), out[i]) << i << " " << in[i];
+  }
+}
+
+TEST(colormap_lut, MapInfinityInEveryLane) {
+  const colormap_lut lut(read_colormap_from_string("sine", 7));
+  for (const double inf : {INFINITY, -INFINITY}) {
+    for (size_t lane = 0; lane < 8; lane++) {
+      std::vector<double> in(11, 0.3);
+      in[lane] = inf;
+      std::vector<RGB> out(in.size());
+      lut.map(in.data(), in.size(), out.data());
+      ASSERT_EQ(lut(inf), out[lane]) << inf << " " << lane;
+    }
+  }
+}
+
+TEST(colormap_lut, GrayscaleToRgbChunks) {
+  const colormap cmap = read_colormap_from_string("hot");
+  const colormap_lut lut(cmap);
+  // a few chunks and a partial one
+  matrix<double> in(301, 123);
+  for (size_t i = 0; i < in.size(); i++) {
+    in.data()[i] = (i % 1000) / 1000.0;
+  }
+  image_RGB from_lut(in.x(), in.y());
+  image_RGB from_cmap(in.x(), in.y());
+  grayscale_to_rgb(in, from_lut, lut);
+  grayscale_to_rgb(in, from_cmap, cmap);
+  for (size_t i = 0; i < in.size(); i++) {
+    ASSERT_EQ(lut(in.data()[i]), from_lut.data()[i]) << i;
+    ASSERT_EQ(cmap(in.data()[i]), from_cmap.data()[i]) << i;
+  }
+}
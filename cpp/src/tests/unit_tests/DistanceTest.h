@@ -0,0 +1,74 @@
+// (c) Copyright 2017 Josh Wright
+#pragma once
+
+#include <gtest/gtest.h>
+#include <random>
+#include "fractal/fractal_impl.h"
+
+using namespace image_utils;
+
+/* the derivative that comes out of the dual numbers must match a finite difference */
+TEST(distance, DualDerivative) {
+  std::mt19937 gen(3);
+  std::uniform_real_distribution<double> dist(-1, 1);
+  func_quadratic_rational<double> poly;
+  const double h = 1e-6;
+  for (int n = 0; n < 1000; n++) {
+    const std::complex<double> z(dist(gen), dist(gen));
+    const std::complex<double> c(dist(gen), dist(gen));
+    const dual_complex<double> out =
+        poly(dual_complex<double>(z), dual_complex<double>(c, std::complex<double>(1, 0)));
+    const std::complex<double> diff = (poly(z, c + h) - poly(z, c - h)) / (2 * h);
+    ASSERT_EQ(poly(z, c), out.v);
+    ASSERT_NEAR(0, std::abs(out.d - diff), 1e-4 * (1 + std::abs(diff))) << z << " " << c;
+  }
+}
+
+/* points on the real axis, where the distance to the set is known */
+TEST(distance, RealAxis) {
+  fractal_info cfg;
+  cfg.x = 100;
+  cfg.y = 100;
+  cfg.iter = 1000;
+  cfg.distance = true;
+  fractal_impl<double, func_standard<double>> f(cfg.x, cfg.y);
+  f.read_config(cfg);
+  const double pixel = 2 * std::min(f.pixel_width_x, f.pixel_width_y);
+  // the set meets the real axis on [-2, 0.25]
+  for (const double x : {0.5, 1.0, -2.5, -3.0}) {
+    const double expected = x > 0 ? x - 0.25 : -2 - x;
+    const double d = f.iterate_cell(complex(x, 0)) * pixel;
+    EXPECT_GT(d, expected / 4) << x;
+    EXPECT_LT(d, expected * 4) << x;
+  }
+  EXPECT_EQ(0, f.iterate_cell(complex(-0.1, 0)));
+  EXPECT_EQ(0, f.iterate_cell(complex(-1.3, 0)));
+}
+
+TEST(distance, WholeImage) {
+  fractal_info cfg;
+  cfg.x = 90;
+  cfg.y = 60;
+  cfg.iter = 500;
+  cfg.distance = true;
+  for (const bool julia : {false, true}) {
+    cfg.is_julia = julia;
+    cfg.cr = "-0.8";
+    cfg.ci = "0.156";
+    auto f = get_fractal(cfg);
+    f->run();
+    size_t zeros = 0;
+    for (size_t i = 0; i < cfg.x; i++) {
+      for (size_t j = 0; j < cfg.y; j++) {
+        const double v = f->cell(i, j);
+        ASSERT_FALSE(std::isnan(v)) << "(" << i << "," << j << ")";
+        ASSERT_GE(v, 0);
+        ASSERT_LE(v, 1);
+        zeros += v == 0;
+      }
+    }
+    // the set is in the middle, the corners are far from it
+    EXPECT_GT(zeros, 0u);
+    EXPECT_GT(f->cell(0, 0), 0.5);
+  }
+}
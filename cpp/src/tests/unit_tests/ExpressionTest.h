@@ -0,0 +1,96 @@
+// (c) Copyright 2017 Josh Wright
+#pragma once
+
+#include <gtest/gtest.h>
+#include <random>
+#include "FractalTestConfig.h"
+#include "fractal/fractal_expression.h"
+#include "fractal/fractal_impl.h"
+
+using namespace image_utils;
+
+/* the expression has to give exactly what fractal_impl gives, including the filled rectangles */
+template <typename polynomial>
+static void expect_expression_exact(fractal_info cfg, const std::string &expr) {
+  fractal_impl<double, polynomial> reference(cfg.x, cfg.y);
+  reference.read_config(cfg);
+  reference.do_sine_transform = false;
+  reference.run();
+  cfg.poly = expr;
+  fractal_ref fract = get_fractal(cfg);
+  ASSERT_TRUE(std::dynamic_pointer_cast<fractal_expression>(fract) != nullptr);
+  fract->do_sine_transform = false;
+  fract->run();
+  EXPECT_EQ(reference.iterated_pixels, fract->iterated_pixels) << expr;
+  for (size_t i = 0; i < cfg.x; i++) {
+    for (size_t j = 0; j < cfg.y; j++) {
+      ASSERT_EQ(reference.cell(i, j), fract->cell(i, j)) << expr << " (" << i << "," << j << ")";
+    }
+  }
+}
+
+TEST(expression, SameAsBuiltInPolynomials) {
+  fractal_info cfg = seahorse_cfg(90, 70);
+  expect_expression_exact<func_standard<double>>(cfg, "z^2 + c");
+  cfg.interior = false;
+  cfg.subsample = true;
+  expect_expression_exact<func_standard<double>>(cfg, "z*z+c");
+  cfg.r = "0";
+  cfg.i = "0";
+  cfg.zoom = "1";
+  cfg.interior = true;
+  cfg.subsample = false;
+  cfg.smooth = false;
+  expect_expression_exact<func_cubic<double>>(cfg, "z^3 + c");
+  cfg.is_julia = true;
+  cfg.cr = "0.3";
+  cfg.ci = "-0.5";
+  expect_expression_exact<func_cubic<double>>(cfg, "(z * z) * z + c");
+}
+
+TEST(expression, Evaluate) {
+  std::mt19937 gen(3);
+  std::uniform_real_distribution<double> dist(-2, 2);
+  func_quadratic_rational<double> rational;
+  func_inv_c_parabola<double> parabola;
+  const expression_program p1 = compile_expression("z^2 + c^2 / (c^4 - .25)");
+  const expression_program p2 = compile_expression("z*z + 1/c + 0.25");
+  const expression_program p3 = compile_expression("-(z - 2i)^-2 * 3");
+  for (int n = 0; n < 1000; n++) {
+    const complex z(dist(gen), dist(gen)), c(dist(gen), dist(gen));
+    const complex r1 = evaluate_expression(p1, z, c), e1 = rational(z, c);
+    const complex r2 = evaluate_expression(p2, z, c), e2 = parabola(z, c);
+    const complex r3 = evaluate_expression(p3, z, c), e3 = -3.0 / ((z - complex(0, 2)) * (z - complex(0, 2)));
+    EXPECT_NEAR(0, std::abs(r1 - e1), 1e-12 * (1 + std::abs(e1)));
+    EXPECT_NEAR(0, std::abs(r2 - e2), 1e-12 * (1 + std::abs(e2)));
+    EXPECT_NEAR(0, std::abs(r3 - e3), 1e-12 * (1 + std::abs(e3)));
+  }
+}
+
+TEST(expression, Compile) {
+  // constants are folded
+  expression_program p = compile_expression("(1 + 2) * 0.5i - i");
+  ASSERT_EQ(1u, p.code.size());
+  EXPECT_EQ(EXPR_COPY, p.code[0].op);
+  EXPECT_EQ(complex(0, 0.5), evaluate_expression(p, complex(7, 7), complex(5, 5)));
+  // straight into z, with nothing left over
+  p = compile_expression("z^2+c");
+  ASSERT_EQ(2u, p.code.size());
+  EXPECT_EQ(EXPR_SQR, p.code[0].op);
+  EXPECT_EQ(0u, p.code[1].dst);
+  // temporaries are reused: z, c, the constants and 4 temporaries
+  p = compile_expression("(z+1)*(z+2) + (z+3)*(z+4) + (z+5)*(z+6)");
+  EXPECT_EQ(2u + 6u + 4u, p.n_registers);
+  EXPECT_EQ(complex(0, 0), evaluate_expression(compile_expression("z"), complex(0, 0), 1.0));
+
+  for (const char *bad : {"", "z +", "(z", "z)", "w", "z^", "z^1.5", "z^100", "2z", "z**2"}) {
+    EXPECT_THROW(compile_expression(bad), std::runtime_error) << bad;
+  }
+  fractal_info cfg;
+  cfg.poly = "z^2 + c";
+  cfg.bits = 128;
+  EXPECT_THROW(get_fractal(cfg), std::runtime_error);
+  EXPECT_TRUE(is_custom_polynomial("z^2 + c"));
+  EXPECT_FALSE(is_custom_polynomial("cubic"));
+  EXPECT_FALSE(is_custom_polynomial(""));
+}
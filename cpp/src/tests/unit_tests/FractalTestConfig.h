@@ -0,0 +1,20 @@
+// (c) Copyright 2017 Josh Wright
+#pragma once
+
+#include "fractal/fractal_info.h"
+
+/**
+ * seahorse valley at zoom 40: bulbs, spirals and thin filaments in a small image, so most pixels
+ * are neither trivially inside nor far outside. tests only set the fields they are about on top
+ */
+inline fractal_info seahorse_cfg(const size_t x = 120, const size_t y = 90) {
+  fractal_info cfg;
+  cfg.x = x;
+  cfg.y = y;
+  cfg.iter = 500;
+  cfg.smooth = true;
+  cfg.r = "-0.745";
+  cfg.i = "0.11";
+  cfg.zoom = "40";
+  return cfg;
+}
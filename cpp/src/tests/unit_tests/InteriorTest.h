@@ -0,0 +1,52 @@
+// (c) Copyright 2017 Josh Wright
+#pragma once
+
+#include <gtest/gtest.h>
+#include "FractalTestConfig.h"
+#include "fractal/fractal_impl.h"
+
+using namespace image_utils;
+
+/* every pixel must come out the same with and without the interior checks */
+template <typename polynomial>
+static void expect_interior_check_exact(fractal_info cfg) {
+  fractal_impl<double, polynomial> checked(cfg.x, cfg.y);
+  cfg.interior = true;
+  checked.read_config(cfg);
+  fractal_impl<double, polynomial> full(cfg.x, cfg.y);
+  cfg.interior = false;
+  full.read_config(cfg);
+
+  for (size_t i = 0; i < cfg.x; i++) {
+    for (size_t j = 0; j < cfg.y; j++) {
+      auto pos = checked.index_to_complex(vec_ull{i, j});
+      ASSERT_EQ(full.iterate_cell(pos), checked.iterate_cell(pos)) << "(" << i << "," << j << ")";
+    }
+  }
+}
+
+TEST(interior, CardioidAndPeriodicity) {
+  fractal_info cfg = seahorse_cfg(120, 80);
+  cfg.iter = 2000;
+  // lots of interior that isn't in the cardioid or the bulb
+  expect_interior_check_exact<func_standard<double>>(cfg);
+  cfg.r = "-0.5";
+  cfg.i = "0";
+  cfg.zoom = "1";
+  expect_interior_check_exact<func_standard<double>>(cfg);
+}
+
+TEST(interior, PeriodicityOtherPolynomials) {
+  fractal_info cfg;
+  cfg.x = 120;
+  cfg.y = 80;
+  cfg.iter = 2000;
+  expect_interior_check_exact<func_cubic<double>>(cfg);
+  cfg.is_julia = true;
+  cfg.cr = "-0.8";
+  cfg.ci = "0.156";
+  expect_interior_check_exact<func_standard<double>>(cfg);
+  cfg.cr = "-0.12";
+  cfg.ci = "0.75";
+  expect_interior_check_exact<func_standard<double>>(cfg);
+}
@@ -0,0 +1,54 @@
+// (c) Copyright 2017 Josh Wright
+#pragma once
+
+#include <gtest/gtest.h>
+#include <thread>
+#include "util/mpmc_queue.h"
+
+using namespace image_utils;
+
+TEST(mpmc_queue, FullAndEmpty) {
+  mpmc_queue<int> q(4);
+  int x;
+  ASSERT_FALSE(q.try_pop(x));
+  for (int i = 0; i < 4; i++) {
+    ASSERT_TRUE(q.try_push(i));
+  }
+  ASSERT_FALSE(q.try_push(4));
+  for (int i = 0; i < 4; i++) {
+    ASSERT_TRUE(q.try_pop(x));
+    ASSERT_EQ(i, x);
+  }
+  ASSERT_FALSE(q.try_pop(x));
+  ASSERT_THROW(mpmc_queue<int>(6), std::runtime_error);
+}
+
+TEST(mpmc_queue, ManyProducersAndConsumers) {
+  const size_t n_threads = 4;
+  const size_t per_thread = 20000;
+  // small enough that both sides have to wait on each other
+  mpmc_queue<size_t> q(8);
+  std::vector<std::thread> threads;
+  std::vector<size_t> sums(n_threads, 0);
+  for (size_t t = 0; t < n_threads; t++) {
+    threads.emplace_back([&, t]() {
+      for (size_t i = 0; i < per_thread; i++) {
+        q.push(t * per_thread + i + 1);
+      }
+    });
+    threads.emplace_back([&, t]() {
+      for (size_t i = 0; i < per_thread; i++) {
+        sums[t] += q.pop();
+      }
+    });
+  }
+  for (std::thread &t : threads) {
+    t.join();
+  }
+  const size_t n = n_threads * per_thread;
+  size_t total = 0;
+  for (size_t s : sums) {
+    total += s;
+  }
+  ASSERT_EQ(n * (n + 1) / 2, total);
+}
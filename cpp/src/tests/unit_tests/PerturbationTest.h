@@ -0,0 +1,105 @@
+// (c) Copyright 2017 Josh Wright
+#pragma once
+
+#include <gtest/gtest.h>
+#include <boost/multiprecision/gmp.hpp>
+#include "fractal/fractal_common.h"
+#include "fractal/fractal_perturbation.h"
+
+using namespace image_utils;
+
+/* render cfg with the given backend and count pixels that differ */
+static size_t count_perturbation_mismatches(fractal_info cfg) {
+  cfg.perturbation = false;
+  fractal_ref expected = get_fractal(cfg);
+  expected->do_sine_transform = false;
+  expected->run();
+
+  cfg.perturbation = true;
+  fractal_ref actual = get_fractal(cfg);
+  actual->do_sine_transform = false;
+  actual->run();
+
+  size_t fails = 0;
+  for (size_t i = 0; i < expected->iterations.size(); i++) {
+    if (std::fabs(expected->iterations(i) - actual->iterations(i)) > 0.001) {
+      fails++;
+    }
+  }
+  return fails;
+}
+
+TEST(perturbation, MatchesDoubleAtLowZoom) {
+  fractal_info cfg;
+  cfg.x = 200;
+  cfg.y = 150;
+  cfg.iter = 512;
+  cfg.smooth = true;
+  cfg.r = "-0.5";
+  // a few chaotic pixels right on the boundary are allowed to disagree
+  ASSERT_GE(cfg.x * cfg.y * 0.001, count_perturbation_mismatches(cfg));
+}
+
+TEST(perturbation, MatchesMpfAtDeepZoom) {
+  fractal_info cfg;
+  cfg.x = 32;
+  cfg.y = 24;
+  cfg.iter = 4000;
+  cfg.smooth = true;
+  cfg.bits = 60;
+  cfg.r = "-0.74364382703690102651515151515";
+  cfg.i = "0.13182496545639553814015151515";
+  cfg.zoom = "1e22";
+  ASSERT_EQ(0u, count_perturbation_mismatches(cfg));
+}
+
+TEST(perturbation, SeriesApproximationSkipsIterations) {
+  fractal_info cfg;
+  cfg.x = 64;
+  cfg.y = 48;
+  cfg.iter = 20000;
+  cfg.smooth = true;
+  cfg.perturbation = true;
+  cfg.r = "-0.74364382703690102651515151515";
+  cfg.i = "0.13182496545639553814015151515";
+  cfg.zoom = "1e22";
+
+  cfg.series_terms = 0;
+  fractal_ref expected = get_fractal(cfg);
+  expected->run();
+
+  cfg.series_terms = 8;
+  auto actual = std::static_pointer_cast<fractal_perturbation>(get_fractal(cfg));
+  actual->run();
+
+  ASSERT_LT(1000u, actual->skipped_iterations);
+  for (size_t i = 0; i < expected->iterations.size(); i++) {
+    ASSERT_NEAR(expected->iterations(i), actual->iterations(i), 0.001);
+  }
+}
+
+/* frames at different zooms render at the same time, so the orbit can't use the shared default */
+TEST(perturbation, OrbitIgnoresDefaultPrecision) {
+  fractal_info cfg;
+  cfg.x = 32;
+  cfg.y = 24;
+  cfg.iter = 4000;
+  cfg.perturbation = true;
+  cfg.r = "-0.74364382703690102651515151515";
+  cfg.i = "0.13182496545639553814015151515";
+  cfg.zoom = "1e22";
+  typedef boost::multiprecision::mpf_float mpf_float;
+  const unsigned saved = mpf_float::default_precision();
+  fractal_ref expected = get_fractal(cfg);
+  expected->run();
+  ASSERT_EQ(saved, mpf_float::default_precision());
+
+  // what a shallow frame could leave behind
+  mpf_float::default_precision(10);
+  fractal_ref actual = get_fractal(cfg);
+  actual->run();
+  mpf_float::default_precision(saved);
+  for (size_t i = 0; i < expected->iterations.size(); i++) {
+    ASSERT_EQ(expected->iterations(i), actual->iterations(i)) << i;
+  }
+}
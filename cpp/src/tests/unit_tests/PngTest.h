@@ -0,0 +1,88 @@
+// (c) Copyright 2017 Josh Wright
+#pragma once
+
+#include <gtest/gtest.h>
+#include <cstdio>
+#include "io.h"
+#include "lodepng.h"
+
+using namespace image_utils;
+
+class PngTest : public ::testing::TestWithParam<png_settings> {};
+
+static image_RGB png_test_image() {
+  image_RGB image(203, 97);
+  for (size_t x = 0; x < image.x(); x++) {
+    for (size_t y = 0; y < image.y(); y++) {
+      image(x, y) = RGB{(unsigned char)(x * y), (unsigned char)(x + 3 * y), (unsigned char)(x ^ y)};
+    }
+  }
+  return image;
+}
+
+TEST_P(PngTest, DecodesToSameImage) {
+  const image_RGB image = png_test_image();
+  std::vector<unsigned char> png = encode_png(image, GetParam());
+  std::vector<unsigned char> decoded;
+  unsigned w, h;
+  ASSERT_EQ(0u, lodepng::decode(decoded, w, h, png, LCT_RGB));
+  ASSERT_EQ(image.x(), w);
+  ASSERT_EQ(image.y(), h);
+  ASSERT_EQ(0, std::memcmp(decoded.data(), image.data(), decoded.size()));
+}
+
+TEST_P(PngTest, StreamDecodesToSameImage) {
+  const image_RGB image = png_test_image();
+  const std::string path = testing::TempDir() + "png_stream_test.png";
+  {
+    png_stream stream(path, image.x(), image.y(), GetParam());
+    // bands of different sizes, including an empty one
+    size_t y = 0;
+    for (const size_t rows : {1, 40, 0, 33, 23}) {
+      image_RGB band(image.x(), rows);
+      std::memcpy(band.data(), image.data() + y * image.x(), rows * image.x() * sizeof(RGB));
+      stream.write(band);
+      y += rows;
+    }
+    ASSERT_THROW(stream.write(image_RGB(image.x(), 1)), std::runtime_error);
+    stream.close();
+  }
+  std::vector<unsigned char> decoded;
+  unsigned w, h;
+  ASSERT_EQ(0u, lodepng::decode(decoded, w, h, path, LCT_RGB));
+  ASSERT_EQ(image.x(), w);
+  ASSERT_EQ(image.y(), h);
+  ASSERT_EQ(0, std::memcmp(decoded.data(), image.data(), decoded.size()));
+  std::remove(path.c_str());
+}
+
+static png_settings small_chunks(int level, png_filter filter) {
+  png_settings s;
+  s.level = level;
+  s.filter = filter;
+  // many chunks, and one that doesn't end on a row
+  s.chunk_size = 5000;
+  return s;
+}
+
+INSTANTIATE_TEST_CASE_P(PngSettings, PngTest,
+                        ::testing::Values(png_settings(), png_settings::fast(),
+                                          png_settings::store(),
+                                          small_chunks(9, PNG_FILTER_ENTROPY),
+                                          small_chunks(1, PNG_FILTER_MINSUM),
+                                          small_chunks(0, PNG_FILTER_ZERO)));
+
+TEST(png, InvalidLevel) {
+  png_settings s;
+  s.level = 10;
+  ASSERT_THROW(encode_png(image_RGB(4, 4), s), std::runtime_error);
+}
+
+TEST(png, StreamMissingRows) {
+  const std::string path = testing::TempDir() + "png_stream_short.png";
+  png_stream stream(path, 4, 4);
+  ASSERT_THROW(stream.write(image_RGB(3, 2)), std::runtime_error);
+  stream.write(image_RGB(4, 2));
+  ASSERT_THROW(stream.close(), std::runtime_error);
+  std::remove(path.c_str());
+}
@@ -0,0 +1,31 @@
+// (c) Copyright 2017 Josh Wright
+#pragma once
+
+#include <gtest/gtest.h>
+#include <random>
+#include "fractal/fractal_common.h"
+
+using namespace image_utils;
+
+/* the written out polynomials must give exactly what the std::complex functor gives */
+template <typename polynomial>
+static void expect_step_exact() {
+  std::mt19937 gen(7);
+  std::uniform_real_distribution<double> dist(-2, 2);
+  polynomial poly;
+  for (int n = 0; n < 10000; n++) {
+    const std::complex<double> z(dist(gen), dist(gen));
+    const std::complex<double> c(dist(gen), dist(gen));
+    const std::complex<double> expected = poly(z, c);
+    double zr = z.real(), zi = z.imag();
+    polynomial_step<double, polynomial>::step(poly, zr, zi, c.real(), c.imag(), zr * zr, zi * zi);
+    ASSERT_EQ(expected.real(), zr) << z << " " << c;
+    ASSERT_EQ(expected.imag(), zi) << z << " " << c;
+  }
+}
+
+TEST(polynomial_step, SameAsComplex) {
+  expect_step_exact<func_standard<double>>();
+  expect_step_exact<func_cubic<double>>();
+  expect_step_exact<func_inv_c<double>>();
+}
@@ -0,0 +1,48 @@
+// (c) Copyright 2017 Josh Wright
+#pragma once
+
+#include <gtest/gtest.h>
+#include "FractalTestConfig.h"
+#include "fractal/fractal_impl.h"
+#include "fractal/post_process.h"
+#include "io.h"
+
+using namespace image_utils;
+
+TEST(post_process, SameAsSeparatePasses) {
+  fractal_info cfg = seahorse_cfg(150, 101);
+  cfg.iter = 1000;
+  cfg.tile = 32;
+  fractal_impl<double> f(cfg.x, cfg.y);
+  f.read_config(cfg);
+  f.do_sine_transform = false;
+  f.run();
+  const colormap cmap = read_colormap_from_string("hot");
+
+  post_process_settings settings;
+  settings.sine_mul = 3;
+  image_RGB fused(cfg.x, cfg.y);
+  post_process_stats stats = post_process(f.iterations, f.layout, settings, cmap, fused);
+
+  matrix<double> expected = untile(f.iterations, f.layout);
+  log_transform(expected);
+  sine_transform(expected, settings.sine_mul);
+  auto range = std::minmax_element(expected.begin(), expected.end());
+  ASSERT_EQ(*range.first, stats.min);
+  ASSERT_EQ(*range.second, stats.max);
+  scale_grid(expected);
+  image_RGB separate(cfg.x, cfg.y);
+  grayscale_to_rgb(expected, separate, cmap);
+  for (size_t i = 0; i < cfg.x; i++) {
+    for (size_t j = 0; j < cfg.y; j++) {
+      ASSERT_EQ(separate(i, j), fused(i, j)) << "(" << i << "," << j << ")";
+    }
+  }
+
+  // a float buffer only loses precision
+  matrix<float> small(cfg.x, cfg.y);
+  std::copy(f.iterations.begin(), f.iterations.end(), small.begin());
+  image_RGB from_float(cfg.x, cfg.y);
+  stats = post_process(small, f.layout, settings, cmap, from_float);
+  ASSERT_NEAR(*range.second, stats.max, 1e-5);
+}
@@ -0,0 +1,47 @@
+// (c) Copyright 2017 Josh Wright
+#pragma once
+
+#include <gtest/gtest.h>
+#include "FractalTestConfig.h"
+#include "fractal/fractal_impl.h"
+
+using namespace image_utils;
+
+TEST(progressive, SameAsRunWithoutRepeats) {
+  fractal_info cfg = seahorse_cfg(103, 77);
+  cfg.tile = 16;
+  fractal_impl<double> full(cfg.x, cfg.y);
+  full.read_config(cfg);
+  full.run();
+
+  fractal_impl<double> progressive(cfg.x, cfg.y);
+  progressive.read_config(cfg);
+  std::vector<size_t> strides;
+  progressive.run_progressive([&](const size_t stride) {
+    strides.push_back(stride);
+    if (stride == 4) {
+      // blocks copy their corner
+      EXPECT_EQ(progressive.cell(8, 4), progressive.cell(11, 7));
+    }
+    return true;
+  });
+  ASSERT_EQ((std::vector<size_t>{4, 2, 1}), strides);
+  // every pixel exactly once
+  ASSERT_EQ(cfg.x * cfg.y, progressive.iterated_pixels);
+  for (size_t x = 0; x < cfg.x; x++) {
+    for (size_t y = 0; y < cfg.y; y++) {
+      ASSERT_EQ(full.cell(x, y), progressive.cell(x, y)) << x << "," << y;
+    }
+  }
+}
+
+TEST(progressive, Abort) {
+  fractal_info cfg;
+  cfg.x = 64;
+  cfg.y = 64;
+  fractal_impl<double> f(cfg.x, cfg.y);
+  f.read_config(cfg);
+  size_t levels = 0;
+  f.run_progressive([&](const size_t) { return ++levels < 2; });
+  ASSERT_EQ(2u, levels);
+}
@@ -0,0 +1,160 @@
+// (c) Copyright 2017 Josh Wright
+#pragma once
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <tuple>
+#include "fractal/fractal_avx.h"
+#include "fractal/fractal_impl.h"
+
+using namespace image_utils;
+using ::testing::TestWithParam;
+using ::testing::Values;
+using ::testing::Combine;
+using ::testing::Bool;
+
+/* instruction set, poly, is_julia, smooth, subsample */
+typedef std::tuple<simd_isa, std::string, bool, bool, bool> simd_fractal_test_param_t;
+
+class SimdFractalTest : public ::testing::TestWithParam<simd_fractal_test_param_t> {
+ protected:
+  void SetUp() override {
+    using std::get;
+    simd_fractal_test_param_t param = GetParam();
+    // odd sizes so that the last group of pixels is only partly used
+    cfg.x = 157;
+    cfg.y = 101;
+    cfg.iter = 512;
+    cfg.r = "-0.5";
+    cfg.cr = "-0.8";
+    cfg.ci = "0.156";
+    isa = get<0>(param);
+    cfg.poly = get<1>(param);
+    cfg.is_julia = get<2>(param);
+    cfg.smooth = get<3>(param);
+    cfg.subsample = get<4>(param);
+  }
+
+  template <typename polynomial>
+  void expect_same_as_impl() {
+    if (isa > detect_simd_isa()) {
+      // can't run here
+      return;
+    }
+    fractal_impl<double, polynomial> expected(cfg.x, cfg.y);
+    expected.read_config(cfg);
+
+    cfg.simd = true;
+    fractal_ref actual = get_fractal(cfg);
+    auto simd = std::dynamic_pointer_cast<fractal_avx_f64>(actual);
+    ASSERT_NE(nullptr, simd);
+    simd->isa = isa;
+    actual->do_sine_transform = false;
+    actual->run();
+
+    for (size_t i = 0; i < cfg.x; i++) {
+      for (size_t j = 0; j < cfg.y; j++) {
+        ASSERT_EQ(expected.iterate_cell(expected.index_to_complex(vec_ull{i, j})),
+                  actual->iterations(i, j))
+            << "(" << i << "," << j << ")";
+      }
+    }
+  }
+
+  simd_isa isa;
+  fractal_info cfg;
+};
+
+INSTANTIATE_TEST_CASE_P(SimdFractalTests, SimdFractalTest,
+                        Combine(Values(ISA_SSE2, ISA_AVX, ISA_AVX2, ISA_AVX512),
+                                Values("standard", "cubic"), Bool(), Bool(), Bool()));
+
+TEST_P(SimdFractalTest, SameAsFractalImpl) {
+  if (cfg.poly == "cubic") {
+    expect_same_as_impl<func_cubic<double>>();
+  } else {
+    expect_same_as_impl<func_standard<double>>();
+  }
+}
+
+TEST_P(SimdFractalTest, NoIterations) {
+  // the cap is 0, so every orbit escapes right away except the one at c = 0 (the middle pixel of
+  // an even sized image), which has to stop on the iteration count alone
+  cfg.x = 156;
+  cfg.y = 100;
+  cfg.r = "0";
+  cfg.iter = 0;
+  cfg.interior = false;
+  if (cfg.poly == "cubic") {
+    expect_same_as_impl<func_cubic<double>>();
+  } else {
+    expect_same_as_impl<func_standard<double>>();
+  }
+}
+
+TEST(SimdFractalFmaTest, FromConfig) {
+  fractal_info cfg;
+  cfg.x = 120;
+  cfg.y = 80;
+  cfg.r = "-0.5";
+  cfg.simd = true;
+  cfg.fma = true;
+  fractal_ref actual = get_fractal(cfg);
+  auto simd = std::dynamic_pointer_cast<fractal_avx_f64>(actual);
+  ASSERT_NE(nullptr, simd);
+  ASSERT_TRUE(simd->fused);
+  actual->do_sine_transform = false;
+  actual->run();
+  fractal_impl<double, func_standard<double>> expected(cfg.x, cfg.y);
+  expected.read_config(cfg);
+  // rounding differences only move a few escape times
+  size_t same = 0;
+  for (size_t i = 0; i < cfg.x; i++) {
+    for (size_t j = 0; j < cfg.y; j++) {
+      same += expected.iterate_cell(expected.index_to_complex(vec_ull{i, j})) ==
+              actual->iterations(i, j);
+    }
+  }
+  ASSERT_GT(same, cfg.x * cfg.y * 95 / 100);
+}
+
+TEST(SimdFractalSingleThreadTest, SameAsMultiThread) {
+  fractal_info cfg;
+  cfg.x = 157;
+  cfg.y = 101;
+  cfg.r = "-0.5";
+  cfg.simd = true;
+  fractal_ref single = get_fractal(cfg);
+  fractal_ref multi = get_fractal(cfg);
+  single->run_singlethread();
+  multi->run_multithread();
+  ASSERT_TRUE(std::equal(multi->iterations.begin(), multi->iterations.end(),
+                         single->iterations.begin()));
+}
+
+TEST(SimdPreviewTest, OddWidthSameOnEveryIsa) {
+  fractal_info cfg;
+  // not a multiple of any vector width, so vectors span rows and the last one is partly idle
+  cfg.x = 203;
+  cfg.y = 77;
+  cfg.iter = 300;
+  std::vector<matrix<double>> results;
+  for (simd_isa isa : {ISA_SSE2, ISA_AVX, ISA_AVX2, ISA_AVX512}) {
+    if (isa > detect_simd_isa()) {
+      break;
+    }
+    auto f = std::dynamic_pointer_cast<fractal_avx_f32>(get_fractal_avx_f32(cfg));
+    f->isa = isa;
+    std::fill(f->iterations.begin(), f->iterations.end(), -1.0);
+    f->run_avx_f32(true);
+    results.push_back(f->iterations);
+  }
+  for (size_t i = 0; i < cfg.x; i++) {
+    for (size_t j = 0; j < cfg.y; j++) {
+      ASSERT_LE(1, results[0](i, j)) << "(" << i << "," << j << ")";
+      for (size_t k = 1; k < results.size(); k++) {
+        ASSERT_EQ(results[0](i, j), results[k](i, j)) << "(" << i << "," << j << ")";
+      }
+    }
+  }
+}
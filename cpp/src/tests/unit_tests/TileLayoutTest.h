@@ -0,0 +1,53 @@
+// (c) Copyright 2017 Josh Wright
+#pragma once
+
+#include <gtest/gtest.h>
+#include "FractalTestConfig.h"
+#include "fractal/fractal_impl.h"
+#include "types.h"
+
+using namespace image_utils;
+
+TEST(tile_layout, EveryCellOnce) {
+  // cropped tiles on both edges
+  const size_t w = 150, h = 77;
+  tile_layout layout(w, h, 32);
+  std::vector<int> seen(w * h, 0);
+  for (size_t y = 0; y < h; y++) {
+    for (size_t x = 0; x < w; x++) {
+      ASSERT_GT(w * h, layout.index(x, y));
+      seen[layout.index(x, y)]++;
+    }
+  }
+  for (int n : seen) {
+    ASSERT_EQ(1, n);
+  }
+  ASSERT_THROW(tile_layout(w, h, 48), std::runtime_error);
+}
+
+TEST(tile_layout, TiledRenderSameAsLinear) {
+  fractal_info cfg = seahorse_cfg(201, 133);
+  cfg.iter = 1000;
+  cfg.smooth = false;
+  for (bool border_trace : {false, true}) {
+    cfg.border_trace = border_trace;
+    cfg.tile = 0;
+    fractal_impl<double> linear(cfg.x, cfg.y);
+    linear.read_config(cfg);
+    linear.do_sine_transform = false;
+    linear.run_multithread();
+
+    cfg.tile = 64;
+    fractal_impl<double> tiled(cfg.x, cfg.y);
+    tiled.read_config(cfg);
+    tiled.do_sine_transform = false;
+    tiled.run_multithread();
+
+    matrix<double> untiled = untile(tiled.iterations, tiled.layout);
+    for (size_t i = 0; i < cfg.x; i++) {
+      for (size_t j = 0; j < cfg.y; j++) {
+        ASSERT_EQ(linear.iterations(i, j), untiled(i, j)) << "(" << i << "," << j << ")";
+      }
+    }
+  }
+}
@@ -0,0 +1,54 @@
+// (c) Copyright 2017 Josh Wright
+#pragma once
+
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include "io.h"
+
+using namespace image_utils;
+
+static std::string read_file(const std::string &path) {
+  std::ifstream f(path, std::ios::binary);
+  return std::string(std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>());
+}
+
+TEST(video_stream, Y4mFrames) {
+  const std::string path = testing::TempDir() + "video_stream_test.y4m";
+  image_RGB frame(5, 3, RGB{255, 255, 255});
+  {
+    video_stream stream(path, VIDEO_Y4M, 30);
+    stream.write(frame);
+    frame(0, 0) = RGB{0, 0, 0};
+    stream.write(frame);
+    ASSERT_THROW(stream.write(image_RGB(4, 3)), std::runtime_error);
+  }
+  const std::string data = read_file(path);
+  const std::string header = "YUV4MPEG2 W5 H3 F30:1 Ip A1:1 C444\n";
+  const size_t frame_size = 6 + 3 * 15;
+  ASSERT_EQ(header.size() + 2 * frame_size, data.size());
+  ASSERT_EQ(header, data.substr(0, header.size()));
+  ASSERT_EQ("FRAME\n", data.substr(header.size() + frame_size, 6));
+  // white and black in studio range, no color
+  const size_t second = header.size() + frame_size + 6;
+  ASSERT_EQ(235, (unsigned char)data[header.size() + 6]);
+  ASSERT_EQ(16, (unsigned char)data[second]);
+  ASSERT_EQ(128, (unsigned char)data[second + 15]);
+  ASSERT_EQ(128, (unsigned char)data[second + 30]);
+  std::remove(path.c_str());
+}
+
+TEST(video_stream, RawFrames) {
+  const std::string path = testing::TempDir() + "video_stream_test.rgb";
+  image_RGB frame(4, 2, RGB{1, 2, 3});
+  {
+    video_stream stream(path, VIDEO_RAW_RGB, 60);
+    stream.write(frame);
+    stream.write(frame);
+  }
+  const std::string data = read_file(path);
+  ASSERT_EQ(2 * 3 * 8u, data.size());
+  ASSERT_EQ(0, std::memcmp(data.data(), frame.data(), 3 * 8));
+  std::remove(path.c_str());
+}
@@ -1,5 +1,21 @@
 // (c) Copyright 2016 Josh Wright
 
+#include "AnimatorTest.h"
+#include "AntialiasTest.h"
+#include "BorderTraceTest.h"
+#include "ColormapLutTest.h"
+#include "DistanceTest.h"
+#include "ExpressionTest.h"
+#include "InteriorTest.h"
+#include "MpmcQueueTest.h"
+#include "PerturbationTest.h"
+#include "PolynomialStepTest.h"
+#include "PngTest.h"
+#include "PostProcessTest.h"
+#include "ProgressiveTest.h"
+#include "SimdFractalTest.h"
+#include "TileLayoutTest.h"
+#include "VideoStreamTest.h"
 #include "VoronoiTest.h"
 #include "fractal/fractal_multithread.h"
 #include "fractal/fractal_singlethread.h"